@@ -1,25 +1,27 @@
 #include "assetManager.h"
 
+#include <chrono>
 #include <filesystem>
 
 #include "spdlog/spdlog.h"
-#include "stb_image.h"
 
+#include "threadPool.h"
+#include "uploadManager.h"
 #include "utils.h"
 
 std::map<std::string, std::shared_ptr<Texture>> AssetManager::textures;
 std::map<std::string, std::shared_ptr<Model>> AssetManager::models;
+std::map<std::string, AssetManager::PendingTexture> AssetManager::pendingTextures;
+std::map<std::string, AssetManager::PendingModel> AssetManager::pendingModels;
 
 void AssetManager::loadTexture(Device& device, std::string filepath, std::string name, bool flipped) {
-	stbi_set_flip_vertically_on_load(flipped);
-	std::shared_ptr<Texture> tex = std::make_shared<Texture>(device, filepath);
+	std::shared_ptr<Texture> tex = std::make_shared<Texture>(device, filepath, flipped);
 	textures.insert(std::pair<std::string, std::shared_ptr<Texture>>(name, tex));
 	spdlog::debug("Loaded {}", filepath);
 }
 
 void AssetManager::loadCubeMap(Device& device, std::array<std::string, 6> filepaths, std::string name, bool flipped) {
-	stbi_set_flip_vertically_on_load(flipped);
-	std::shared_ptr<Texture> tex = std::make_shared<Texture>(device, filepaths);
+	std::shared_ptr<Texture> tex = std::make_shared<Texture>(device, filepaths, flipped);
 	textures.insert(std::pair<std::string, std::shared_ptr<Texture>>(name, tex));
 	spdlog::debug("Loaded {}", filepaths[0]);
 }
@@ -36,3 +38,60 @@ void AssetManager::loadModel(Device& device, std::string modelName, std::string
 void AssetManager::clearModels() {
 	models.clear();
 }
+
+std::shared_future<void> AssetManager::queueTexture(std::string filepath, std::string name, bool flipped) {
+	auto image = std::make_shared<Texture::ImageData>();
+	std::shared_future<void> ready = ThreadPool::global().submit([=]() {
+		*image = Texture::ImageData::load(filepath, flipped);
+		spdlog::debug("Decoded {}", filepath);
+	}).share();
+	pendingTextures[name] = { ready, image };
+	return ready;
+}
+
+std::shared_future<void> AssetManager::queueCubeMap(std::array<std::string, 6> filepaths, std::string name, bool flipped) {
+	auto image = std::make_shared<Texture::ImageData>();
+	std::shared_future<void> ready = ThreadPool::global().submit([=]() {
+		*image = Texture::ImageData::loadCubemap(filepaths, flipped);
+		spdlog::debug("Decoded {}", filepaths[0]);
+	}).share();
+	pendingTextures[name] = { ready, image };
+	return ready;
+}
+
+std::shared_future<void> AssetManager::queueModel(std::string modelName, std::string modelFilepath, std::string textureName, Model::VertexFormat format) {
+	auto geometry = std::make_shared<Model::Geometry>();
+	std::shared_future<void> ready = ThreadPool::global().submit([=]() {
+		geometry->loadModel(modelFilepath);
+		spdlog::debug("Parsed {}", modelFilepath);
+	}).share();
+	pendingModels[modelName] = { ready, geometry, textureName, format };
+	return ready;
+}
+
+void AssetManager::finishLoading(Device& device) {
+	auto start = std::chrono::high_resolution_clock::now();
+	size_t count = pendingTextures.size() + pendingModels.size();
+
+	//textures first, models look theirs up by name
+	for (auto& pending : pendingTextures) {
+		pending.second.ready.get();
+		textures[pending.first] = std::make_shared<Texture>(device, *pending.second.image);
+	}
+	pendingTextures.clear();
+
+	for (auto& pending : pendingModels) {
+		pending.second.ready.get();
+		models[pending.first] = std::make_shared<Model>(device, *pending.second.geometry, textures[pending.second.textureName], pending.second.format);
+	}
+	pendingModels.clear();
+
+	device.uploader().wait(device.uploader().submit());
+
+	auto elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	spdlog::debug("Loaded {} queued assets in {:.1f}ms", count, elapsed);
+}
+
+bool AssetManager::isLoading(const std::string& name) {
+	return pendingTextures.count(name) > 0 || pendingModels.count(name) > 0;
+}
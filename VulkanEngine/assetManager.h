@@ -3,6 +3,7 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <future>
 
 #include "texture.h"
 #include "model.h"
@@ -19,7 +20,26 @@ public:
 
 	static void loadModel(Device& device, std::string modelName, std::string modelFilepath, std::string textureFilepath);
 	static void clearModels();
-private:
 
+	//decode/parse on the worker pool, the returned futures (also kept by name) complete when the cpu side is done
+	static std::shared_future<void> queueTexture(std::string filepath, std::string name, bool flipped = false);
+	static std::shared_future<void> queueCubeMap(std::array<std::string, 6> filepaths, std::string name, bool flipped = false);
+	static std::shared_future<void> queueModel(std::string modelName, std::string modelFilepath, std::string textureName, Model::VertexFormat format = Model::VertexFormat::Full);
+	//creates the gpu resources for everything queued, in one upload batch
+	static void finishLoading(Device& device);
+	static bool isLoading(const std::string& name);
+private:
+	struct PendingTexture {
+		std::shared_future<void> ready;
+		std::shared_ptr<Texture::ImageData> image;
+	};
+	struct PendingModel {
+		std::shared_future<void> ready;
+		std::shared_ptr<Model::Geometry> geometry;
+		std::string textureName;
+		Model::VertexFormat format;
+	};
+
+	static std::map<std::string, PendingTexture> pendingTextures;
+	static std::map<std::string, PendingModel> pendingModels;
 };
-
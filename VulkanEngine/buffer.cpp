@@ -25,29 +25,25 @@ Buffer::Buffer(
       memoryPropertyFlags{memoryPropertyFlags} {
   alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
   bufferSize = alignmentSize * instanceCount;
-  device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory);
+  device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, allocation);
 }
 
 Buffer::~Buffer() {
   unmap();
-  vkDestroyBuffer(device.device(), buffer, nullptr);
-  vkFreeMemory(device.device(), memory, nullptr);
+  device.destroyBuffer(buffer, allocation);
 }
 
 VkResult Buffer::map(VkDeviceSize size, VkDeviceSize offset) {
-  assert(buffer && memory && "Called map on buffer before create");
-  if (size == VK_WHOLE_SIZE) {
-    return vkMapMemory(device.device(), memory, 0, bufferSize, 0, &mapped);
+  assert(buffer && allocation.memory && "Called map on buffer before create");
+  // host visible blocks are persistently mapped by the allocator, mapping is just pointer math
+  if (allocation.mapped == nullptr) {
+    return VK_ERROR_MEMORY_MAP_FAILED;
   }
-  return vkMapMemory(device.device(), memory, offset, size, 0, &mapped);
+  mapped = static_cast<char *>(allocation.mapped) + (size == VK_WHOLE_SIZE ? 0 : offset);
+  return VK_SUCCESS;
 }
 
-void Buffer::unmap() {
-  if (mapped) {
-    vkUnmapMemory(device.device(), memory);
-    mapped = nullptr;
-  }
-}
+void Buffer::unmap() { mapped = nullptr; }
 
 void Buffer::writeToBuffer(void *data, VkDeviceSize size, VkDeviceSize offset) {
   assert(mapped && "Cannot copy to unmapped buffer");
@@ -64,18 +60,18 @@ void Buffer::writeToBuffer(void *data, VkDeviceSize size, VkDeviceSize offset) {
 VkResult Buffer::flush(VkDeviceSize size, VkDeviceSize offset) {
   VkMappedMemoryRange mappedRange = {};
   mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-  mappedRange.memory = memory;
-  mappedRange.offset = offset;
-  mappedRange.size = size;
+  mappedRange.memory = allocation.memory;
+  mappedRange.offset = allocation.offset + offset;
+  mappedRange.size = size == VK_WHOLE_SIZE ? bufferSize - offset : size;
   return vkFlushMappedMemoryRanges(device.device(), 1, &mappedRange);
 }
 
 VkResult Buffer::invalidate(VkDeviceSize size, VkDeviceSize offset) {
   VkMappedMemoryRange mappedRange = {};
   mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-  mappedRange.memory = memory;
-  mappedRange.offset = offset;
-  mappedRange.size = size;
+  mappedRange.memory = allocation.memory;
+  mappedRange.offset = allocation.offset + offset;
+  mappedRange.size = size == VK_WHOLE_SIZE ? bufferSize - offset : size;
   return vkInvalidateMappedMemoryRanges(device.device(), 1, &mappedRange);
 }
 
@@ -87,8 +83,9 @@ VkDescriptorBufferInfo Buffer::descriptorInfo(VkDeviceSize size, VkDeviceSize of
   };
 }
 
-void Buffer::writeToIndex(void *data, int index) {
-  writeToBuffer(data, instanceSize, index * alignmentSize);
+void Buffer::writeToIndex(void *data, int index, VkDeviceSize size) {
+  assert((size == VK_WHOLE_SIZE || size <= instanceSize) && "Write is larger than an instance");
+  writeToBuffer(data, size == VK_WHOLE_SIZE ? instanceSize : size, index * alignmentSize);
 }
 
 VkResult Buffer::flushIndex(int index) { return flush(alignmentSize, index * alignmentSize); }
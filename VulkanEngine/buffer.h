@@ -25,7 +25,7 @@ public:
 	VkDescriptorBufferInfo descriptorInfo(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 	VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 
-	void writeToIndex(void* data, int index);
+	void writeToIndex(void* data, int index, VkDeviceSize size = VK_WHOLE_SIZE);
 	VkResult flushIndex(int index);
 	VkDescriptorBufferInfo descriptorInfoForIndex(int index);
 	VkResult invalidateIndex(int index);
@@ -34,7 +34,7 @@ public:
 	void* getMappedMemory() const { return mapped; }
 	uint32_t getInstanceCount() const { return instanceCount; }
 	VkDeviceSize getInstanceSize() const { return instanceSize; }
-	VkDeviceSize getAlignmentSize() const { return instanceSize; }
+	VkDeviceSize getAlignmentSize() const { return alignmentSize; }
 	VkBufferUsageFlags getUsageFlags() const { return usageFlags; }
 	VkMemoryPropertyFlags getMemoryPropertyFlags() const { return memoryPropertyFlags; }
 	VkDeviceSize getBufferSize() const { return bufferSize; }
@@ -45,7 +45,7 @@ private:
 	Device& device;
 	void* mapped = nullptr;
 	VkBuffer buffer = VK_NULL_HANDLE;
-	VkDeviceMemory memory = VK_NULL_HANDLE;
+	Allocation allocation{};
 
 	VkDeviceSize bufferSize;
 	uint32_t instanceCount;
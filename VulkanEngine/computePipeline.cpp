@@ -0,0 +1,52 @@
+#include "computePipeline.h"
+
+#include <stdexcept>
+
+#include "spdlog/spdlog.h"
+
+#include "pipeline.h"
+
+ComputePipeline::ComputePipeline(Device& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout) : device{ device } {
+	if (pipelineLayout == VK_NULL_HANDLE) {
+		spdlog::critical("Failed to find pipelinelayout for {}", compFilepath);
+		throw std::runtime_error("ComputePipeline");
+	}
+
+	auto compCode = Pipeline::readFile(compFilepath);
+	VkShaderModuleCreateInfo moduleInfo{};
+	moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = compCode.size();
+	moduleInfo.pCode = reinterpret_cast<const uint32_t*>(compCode.data());
+
+	if (vkCreateShaderModule(device.device(), &moduleInfo, nullptr, &compShaderModule) != VK_SUCCESS) {
+		spdlog::critical("Failed to create shader module");
+		throw std::runtime_error("ComputePipeline");
+	}
+
+	VkPipelineShaderStageCreateInfo compShaderStage{};
+	compShaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	compShaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	compShaderStage.module = compShaderModule;
+	compShaderStage.pName = "main";
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = compShaderStage;
+	pipelineInfo.layout = pipelineLayout;
+	pipelineInfo.basePipelineIndex = -1;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+	if (vkCreateComputePipelines(device.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
+		spdlog::critical("Failed to create compute pipeline");
+		throw std::runtime_error("ComputePipeline");
+	}
+}
+
+ComputePipeline::~ComputePipeline() {
+	vkDestroyShaderModule(device.device(), compShaderModule, nullptr);
+	vkDestroyPipeline(device.device(), computePipeline, nullptr);
+}
+
+void ComputePipeline::bind(VkCommandBuffer commandBuffer) {
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include "device.h"
+
+class ComputePipeline {
+public:
+	ComputePipeline(Device& device, const std::string& compFilepath, VkPipelineLayout pipelineLayout);
+	~ComputePipeline();
+
+	//delete copy constructors
+	ComputePipeline(const ComputePipeline&) = delete;
+	ComputePipeline& operator=(const ComputePipeline&) = delete;
+
+	void bind(VkCommandBuffer commandBuffer);
+private:
+	Device& device;
+	VkPipeline computePipeline;
+	VkShaderModule compShaderModule;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include "glm/glm.hpp"
@@ -33,6 +35,19 @@ namespace Constants {
 		alignas(16) float tessellatedEdgeSize = 20.0f;
 	};
 
+	static constexpr uint32_t maxWaves = 16;
+	struct WaveUBO {
+		alignas(16) glm::vec4 waves[maxWaves]; //wave vector xz, steepness, angular frequency
+		alignas(16) glm::vec4 params; //time, tile size, wave count
+	};
+
+	struct CullUBO {
+		alignas(16) glm::vec4 frustumPlanes[6];
+		alignas(16) glm::mat4 occlusionViewProj; //camera the depth pyramid was rendered with
+		alignas(16) glm::vec4 pyramid; //depth attachment width and height, pyramid levels, 1 when the pyramid holds a frame
+		alignas(16) uint32_t recordCount;
+	};
+
 	class Frustum
 	{
 	public:
@@ -0,0 +1,34 @@
+#include "culling.h"
+
+#include <cmath>
+
+namespace Culling {
+	void transformBox(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max, glm::vec3& worldMin, glm::vec3& worldMax) {
+		glm::mat3 rotationScale = glm::mat3(transform);
+		glm::vec3 center = glm::vec3(transform * glm::vec4((min + max) * 0.5f, 1.f));
+		glm::vec3 extent = (max - min) * 0.5f;
+		glm::vec3 worldExtent =
+			glm::abs(rotationScale[0]) * extent.x +
+			glm::abs(rotationScale[1]) * extent.y +
+			glm::abs(rotationScale[2]) * extent.z;
+		worldMin = center - worldExtent;
+		worldMax = center + worldExtent;
+	}
+
+	Containment classifyBox(const Constants::Frustum& frustum, const glm::vec3& min, const glm::vec3& max) {
+		glm::vec3 center = (min + max) * 0.5f;
+		glm::vec3 extent = (max - min) * 0.5f;
+		Containment result = Containment::Inside;
+		for (const glm::vec4& plane : frustum.planes) {
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float reach = glm::dot(glm::abs(glm::vec3(plane)), extent);
+			if (distance <= -reach) {
+				return Containment::Outside;
+			}
+			if (distance < reach) {
+				result = Containment::Intersecting;
+			}
+		}
+		return result;
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "glm/glm.hpp"
+
+#include "constants.h"
+
+//cpu visibility tests against the planes of Constants::Frustum
+//bounds are kept in mesh space by the model and moved into world space with the object's transform
+namespace Culling {
+	enum class Containment {
+		Outside,
+		Intersecting,
+		Inside,
+	};
+
+	//world space box around a mesh space one under transform
+	void transformBox(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max, glm::vec3& worldMin, glm::vec3& worldMax);
+
+	//world space box, inside means every plane has all of it in front so nothing under it needs testing
+	Containment classifyBox(const Constants::Frustum& frustum, const glm::vec3& min, const glm::vec3& max);
+}
@@ -0,0 +1,247 @@
+#include "depthPyramid.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "spdlog/spdlog.h"
+
+#include "descriptorManager.h"
+
+static constexpr uint32_t workgroupSize = 8;
+
+DepthPyramid::DepthPyramid(Device& device, Renderer& renderer) : device{ device }, renderer{ renderer } {
+	createSampler();
+	createDescriptorPools();
+	createPipeline();
+	//a placeholder until the first frame is reduced, so the culling set always has something bound
+	createPyramid(1, 1);
+}
+
+DepthPyramid::~DepthPyramid() {
+	pipeline.reset();
+	vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+	for (VkDescriptorPool pool : descriptorPools) {
+		vkDestroyDescriptorPool(device.device(), pool, nullptr);
+	}
+	vkDestroySampler(device.device(), sampler, nullptr);
+	destroyPyramid(device, pyramid);
+}
+
+void DepthPyramid::build(VkCommandBuffer commandBuffer, int frameIndex, VkImageView depthView, VkExtent2D extent, const glm::mat4& viewProj) {
+	if (extent.width != depthExtent.width || extent.height != depthExtent.height) {
+		//the culling pass recorded earlier in this frame still reads the old one
+		renderer.deferDestroy([&device = device, retired = std::move(pyramid)]() mutable { destroyPyramid(device, retired); });
+		pyramid = Pyramid{};
+		createPyramid(std::max(1u, extent.width / 2), std::max(1u, extent.height / 2));
+		depthExtent = extent;
+		valid = false;
+	}
+
+	//the frame that last used this pool has finished, its sets can go
+	vkResetDescriptorPool(device.device(), descriptorPools[frameIndex], 0);
+
+	//the previous build and the culling passes since have finished with every level before it is overwritten
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	//each level reads the one before it, level 0 reads the depth attachment
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	pipeline->bind(commandBuffer);
+	uint32_t width = std::max(1u, extent.width / 2);
+	uint32_t height = std::max(1u, extent.height / 2);
+	for (uint32_t level = 0; level < pyramid.levels.size(); level++) {
+		VkDescriptorSet set = level == 0 ?
+			allocateSet(frameIndex, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, pyramid.levels[0]) :
+			allocateSet(frameIndex, pyramid.levels[level - 1], VK_IMAGE_LAYOUT_GENERAL, pyramid.levels[level]);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, nullptr);
+		vkCmdDispatch(commandBuffer, (width + workgroupSize - 1) / workgroupSize, (height + workgroupSize - 1) / workgroupSize, 1);
+
+		//the last one makes the whole chain visible to the next frame's culling pass
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+		width = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+	}
+
+	this->viewProj = viewProj;
+	valid = true;
+}
+
+void DepthPyramid::createPyramid(uint32_t width, uint32_t height) {
+	uint32_t levelCount = 1;
+	while (levelCount < maxLevels && (std::max(width, height) >> levelCount) > 0) {
+		levelCount++;
+	}
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = levelCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = pyramidFormat;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pyramid.image, pyramid.allocation);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = pyramid.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = pyramidFormat;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = levelCount;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(device.device(), &viewInfo, nullptr, &pyramid.view) != VK_SUCCESS) {
+		spdlog::critical("Failed to create depth pyramid view");
+		throw std::runtime_error("createPyramid");
+	}
+
+	pyramid.levels.resize(levelCount);
+	for (uint32_t level = 0; level < levelCount; level++) {
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+		if (vkCreateImageView(device.device(), &viewInfo, nullptr, &pyramid.levels[level]) != VK_SUCCESS) {
+			spdlog::critical("Failed to create depth pyramid level view");
+			throw std::runtime_error("createPyramid");
+		}
+	}
+
+	//general for good, writes and sampled reads are both allowed there and resizes are rare enough to wait on
+	VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = pyramid.image;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = levelCount;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
+	device.endSingleTimeCommands(commandBuffer);
+}
+
+void DepthPyramid::destroyPyramid(Device& device, Pyramid& pyramid) {
+	for (VkImageView level : pyramid.levels) {
+		vkDestroyImageView(device.device(), level, nullptr);
+	}
+	vkDestroyImageView(device.device(), pyramid.view, nullptr);
+	device.destroyImage(pyramid.image, pyramid.allocation);
+	pyramid = Pyramid{};
+}
+
+void DepthPyramid::createSampler() {
+	//texels are fetched directly, the sampler only has to exist for the combined descriptors
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1.f;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.maxLod = static_cast<float>(maxLevels);
+
+	if (vkCreateSampler(device.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+		spdlog::critical("Failed to create depth pyramid sampler");
+		throw std::runtime_error("createSampler");
+	}
+}
+
+void DepthPyramid::createDescriptorPools() {
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = maxLevels;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = maxLevels;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = maxLevels;
+
+	for (VkDescriptorPool& pool : descriptorPools) {
+		if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+			spdlog::critical("Failed to create depth pyramid descriptor pool");
+			throw std::runtime_error("createDescriptorPools");
+		}
+	}
+}
+
+void DepthPyramid::createPipeline() {
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &DescriptorManager::descriptorSetLayouts.depthPyramid;
+	pipelineLayoutInfo.pushConstantRangeCount = 0;
+
+	if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+		spdlog::critical("Failed to create pipeline layout");
+		throw std::runtime_error("createPipeline");
+	}
+
+	pipeline = std::make_unique<ComputePipeline>(device, "shaders/depthpyramid.spv", pipelineLayout);
+}
+
+VkDescriptorSet DepthPyramid::allocateSet(int frameIndex, VkImageView source, VkImageLayout sourceLayout, VkImageView destination) {
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPools[frameIndex];
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &DescriptorManager::descriptorSetLayouts.depthPyramid;
+
+	VkDescriptorSet set;
+	if (vkAllocateDescriptorSets(device.device(), &allocInfo, &set) != VK_SUCCESS) {
+		spdlog::critical("Failed to allocate depth pyramid descriptor set");
+		throw std::runtime_error("allocateSet");
+	}
+
+	std::array<VkDescriptorImageInfo, 2> imageInfos{};
+	imageInfos[0] = { sampler, source, sourceLayout };
+	imageInfos[1] = { VK_NULL_HANDLE, destination, VK_IMAGE_LAYOUT_GENERAL };
+
+	std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+	for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+		descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[binding].dstSet = set;
+		descriptorWrites[binding].dstBinding = binding;
+		descriptorWrites[binding].dstArrayElement = 0;
+		descriptorWrites[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorWrites[binding].descriptorCount = 1;
+		descriptorWrites[binding].pImageInfo = &imageInfos[binding];
+	}
+	vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	return set;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "glm/glm.hpp"
+
+#include "device.h"
+#include "renderer.h"
+#include "computePipeline.h"
+#include "swapchain.h"
+
+//mip chain of the farthest depth under every texel, reduced from the depth attachment at the end of a frame
+//level 0 is half the attachment, the next frame's culling pass tests object bounds against it
+class DepthPyramid {
+public:
+	DepthPyramid(Device& device, Renderer& renderer);
+	~DepthPyramid();
+
+	//delete copy constructors
+	DepthPyramid(const DepthPyramid&) = delete;
+	DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+	//reduces the depth attachment the frame was just rendered into with viewProj, recorded after the render pass
+	//a new extent recreates the pyramid, the old one lives on until no frame in flight can read it
+	void build(VkCommandBuffer commandBuffer, int frameIndex, VkImageView depthView, VkExtent2D extent, const glm::mat4& viewProj);
+
+	//false until a frame has been reduced, the image is always in general layout so it can be bound regardless
+	bool isValid() const { return valid; }
+	VkDescriptorImageInfo getDescriptorInfo() const { return { sampler, pyramid.view, VK_IMAGE_LAYOUT_GENERAL }; }
+	VkExtent2D getDepthExtent() const { return depthExtent; }
+	uint32_t getLevelCount() const { return static_cast<uint32_t>(pyramid.levels.size()); }
+	const glm::mat4& getViewProj() const { return viewProj; }
+
+private:
+	struct Pyramid {
+		VkImage image = VK_NULL_HANDLE;
+		Allocation allocation{};
+		VkImageView view = VK_NULL_HANDLE;
+		std::vector<VkImageView> levels;
+	};
+
+	static constexpr VkFormat pyramidFormat = VK_FORMAT_R32_SFLOAT;
+	//enough levels for a depth attachment of up to 65536 pixels per side
+	static constexpr uint32_t maxLevels = 16;
+
+	Device& device;
+	Renderer& renderer;
+	Pyramid pyramid;
+	VkExtent2D depthExtent{ 0, 0 };
+	glm::mat4 viewProj{ 1.f };
+	bool valid = false;
+
+	VkSampler sampler;
+	//reduction sets only live for one frame, each frame in flight resets its own pool
+	std::array<VkDescriptorPool, Swapchain::MAX_FRAMES_IN_FLIGHT> descriptorPools;
+	VkPipelineLayout pipelineLayout;
+	std::unique_ptr<ComputePipeline> pipeline;
+
+	void createPyramid(uint32_t width, uint32_t height);
+	//only needs the device, so a deferred one may run after the depth pyramid is gone
+	static void destroyPyramid(Device& device, Pyramid& pyramid);
+	void createSampler();
+	void createDescriptorPools();
+	void createPipeline();
+	VkDescriptorSet allocateSet(int frameIndex, VkImageView source, VkImageLayout sourceLayout, VkImageView destination);
+};
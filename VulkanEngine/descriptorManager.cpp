@@ -19,12 +19,17 @@ DescriptorManager::~DescriptorManager() {
 	vkDestroySampler(device.device(), textureSampler, nullptr);
 	vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayouts.object, nullptr);
 	vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayouts.terrain, nullptr);
+	vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayouts.waves, nullptr);
+	vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayouts.terrainTile, nullptr);
+	vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayouts.terrainDerive, nullptr);
+	vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayouts.culling, nullptr);
+	vkDestroyDescriptorSetLayout(device.device(), descriptorSetLayouts.depthPyramid, nullptr);
 	vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
 }
 
 void DescriptorManager::createDescriptorPool(uint32_t size) {
 	std::array<VkDescriptorPoolSize, 2> poolSizes{};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	poolSizes[0].descriptorCount = size;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	poolSizes[1].descriptorCount = size;
@@ -40,24 +45,25 @@ void DescriptorManager::createDescriptorPool(uint32_t size) {
 	}
 }
 
+VkDescriptorPool DescriptorManager::releaseDescriptorPool() {
+	VkDescriptorPool pool = descriptorPool;
+	descriptorPool = VK_NULL_HANDLE;
+	return pool;
+}
+
 void DescriptorManager::createDescriptorSetLayouts() {
 	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
 
-	//terrain layout
+	//terrain layout, the heights come per tile in set 1
 	setLayoutBindings = {
 		VkDescriptorSetLayoutBinding{0,			//binding
-			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	//type
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,	//type
 			1,									//count
 			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT},		//flags
 		VkDescriptorSetLayoutBinding{1,
-			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			1,
-			VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT| VK_SHADER_STAGE_FRAGMENT_BIT,
-			},
-		VkDescriptorSetLayoutBinding{2,
 			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
 			1,	
-			VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			VK_SHADER_STAGE_FRAGMENT_BIT,
 		},
 	};
 
@@ -72,7 +78,7 @@ void DescriptorManager::createDescriptorSetLayouts() {
 
 	setLayoutBindings = {
 		VkDescriptorSetLayoutBinding{0,			//binding
-			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,	//type
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,	//type
 			1,
 			VK_SHADER_STAGE_VERTEX_BIT,			//stage flags
 			},									//count
@@ -91,6 +97,166 @@ void DescriptorManager::createDescriptorSetLayouts() {
 	if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo2, nullptr, &descriptorSetLayouts.object) != VK_SUCCESS) {
 		spdlog::critical("Failed to create descriptor set layout");
 	}
+
+	//waves layout, storage images for the compute pass and the same images sampled by the water
+	setLayoutBindings = {
+		VkDescriptorSetLayoutBinding{0,
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT,
+			},
+		VkDescriptorSetLayoutBinding{1,
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		VkDescriptorSetLayoutBinding{2,
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		VkDescriptorSetLayoutBinding{3,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			1,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+		VkDescriptorSetLayoutBinding{4,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			1,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			},
+	};
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo3{};
+	layoutInfo3.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo3.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+	layoutInfo3.pBindings = setLayoutBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo3, nullptr, &descriptorSetLayouts.waves) != VK_SUCCESS) {
+		spdlog::critical("Failed to create descriptor set layout");
+	}
+
+	//terrain tile layout, one set per resident tile
+	setLayoutBindings = {
+		VkDescriptorSetLayoutBinding{0,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			1,
+			VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+			},
+		VkDescriptorSetLayoutBinding{1,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			1,
+			VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+			},
+		VkDescriptorSetLayoutBinding{2,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			1,
+			VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+			},
+	};
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo4{};
+	layoutInfo4.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo4.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+	layoutInfo4.pBindings = setLayoutBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo4, nullptr, &descriptorSetLayouts.terrainTile) != VK_SUCCESS) {
+		spdlog::critical("Failed to create descriptor set layout");
+	}
+
+	//terrain derive layout, one set per compute dispatch when a tile is uploaded
+	setLayoutBindings = {
+		VkDescriptorSetLayoutBinding{0,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		VkDescriptorSetLayoutBinding{1,
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		VkDescriptorSetLayoutBinding{2,
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+	};
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo5{};
+	layoutInfo5.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo5.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+	layoutInfo5.pBindings = setLayoutBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo5, nullptr, &descriptorSetLayouts.terrainDerive) != VK_SUCCESS) {
+		spdlog::critical("Failed to create descriptor set layout");
+	}
+
+	//culling layout, one set per frame in flight
+	setLayoutBindings = {
+		VkDescriptorSetLayoutBinding{0,
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		VkDescriptorSetLayoutBinding{1,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		VkDescriptorSetLayoutBinding{2,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		VkDescriptorSetLayoutBinding{3,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		VkDescriptorSetLayoutBinding{4,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		VkDescriptorSetLayoutBinding{5,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+	};
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo6{};
+	layoutInfo6.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo6.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+	layoutInfo6.pBindings = setLayoutBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo6, nullptr, &descriptorSetLayouts.culling) != VK_SUCCESS) {
+		spdlog::critical("Failed to create descriptor set layout");
+	}
+
+	//depth pyramid layout, one set per reduced level
+	setLayoutBindings = {
+		VkDescriptorSetLayoutBinding{0,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+		VkDescriptorSetLayoutBinding{1,
+			VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			1,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			},
+	};
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo7{};
+	layoutInfo7.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo7.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+	layoutInfo7.pBindings = setLayoutBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device.device(), &layoutInfo7, nullptr, &descriptorSetLayouts.depthPyramid) != VK_SUCCESS) {
+		spdlog::critical("Failed to create descriptor set layout");
+	}
 }
 
 void DescriptorManager::createDescriptorSets(uint32_t size) {
@@ -120,33 +286,21 @@ void DescriptorManager::createDescriptorSets(uint32_t size) {
 }
 
 void DescriptorManager::updateTerrainDescriptorSet(GameObject& gameObject,
-	size_t bufferRangeSize,
+	VkDescriptorBufferInfo bufferInfo,
 	VkDescriptorSet descriptorSet,
-	VkBuffer uniformBuffer,
-	VkImageView imageView,
-	VkImageView imageView2) {
-	VkDescriptorBufferInfo bufferInfo{};
-	bufferInfo.buffer = uniformBuffer;
-	bufferInfo.offset = 0;
-	bufferInfo.range = bufferRangeSize;
-
+	VkImageView imageView) {
 	VkDescriptorImageInfo imageInfo{};
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	imageInfo.sampler = textureSampler;
 	imageInfo.imageView = imageView;
 
-	VkDescriptorImageInfo imageInfo2{};
-	imageInfo2.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	imageInfo2.sampler = textureSampler;
-	imageInfo2.imageView = imageView2;
-
-	std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+	std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
 
 	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	descriptorWrites[0].dstSet = descriptorSet;
 	descriptorWrites[0].dstBinding = 0;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorWrites[0].descriptorCount = 1;
 	descriptorWrites[0].pBufferInfo = &bufferInfo;
 
@@ -158,27 +312,13 @@ void DescriptorManager::updateTerrainDescriptorSet(GameObject& gameObject,
 	descriptorWrites[1].descriptorCount = 1;
 	descriptorWrites[1].pImageInfo = &imageInfo;
 
-	descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrites[2].dstSet = descriptorSet;
-	descriptorWrites[2].dstBinding = 2;
-	descriptorWrites[2].dstArrayElement = 0;
-	descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	descriptorWrites[2].descriptorCount = 1;
-	descriptorWrites[2].pImageInfo = &imageInfo2;
-
 	vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
 void DescriptorManager::updateObjectDescriptorSet(GameObject& gameObject, 
-		size_t bufferRangeSize, 
+		VkDescriptorBufferInfo bufferInfo,
 		VkDescriptorSet descriptorSet,
-		VkBuffer uniformBuffer,
 		VkImageView imageView) {
-	VkDescriptorBufferInfo bufferInfo{};
-	bufferInfo.buffer = uniformBuffer;
-	bufferInfo.offset = 0;
-	bufferInfo.range = bufferRangeSize;
-
 	VkDescriptorImageInfo imageInfo{};
 	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	imageInfo.sampler = textureSampler; 
@@ -190,7 +330,7 @@ void DescriptorManager::updateObjectDescriptorSet(GameObject& gameObject,
 	descriptorWrites[0].dstSet = descriptorSet;
 	descriptorWrites[0].dstBinding = 0;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorWrites[0].descriptorCount = 1;
 	descriptorWrites[0].pBufferInfo = &bufferInfo;
 
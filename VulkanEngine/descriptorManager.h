@@ -11,18 +11,17 @@ public:
 	~DescriptorManager();
 
 	void createDescriptorPool(uint32_t size);
+	//hands over the current pool so it can outlive the frames still using its sets
+	VkDescriptorPool releaseDescriptorPool();
 	void createDescriptorSets(uint32_t size);
 	void updateObjectDescriptorSet(GameObject& gameObject,
-		size_t bufferRangeSize, 
+		VkDescriptorBufferInfo bufferInfo,
 		VkDescriptorSet descriptorSet,
-		VkBuffer uniformBuffer,
 		VkImageView imageView);
 	void updateTerrainDescriptorSet(GameObject& gameObject,
-		size_t bufferRangeSize,
+		VkDescriptorBufferInfo bufferInfo,
 		VkDescriptorSet descriptorSet,
-		VkBuffer uniformBuffer,
-		VkImageView imageView,
-		VkImageView imageView2);
+		VkImageView imageView);
 
 	struct DescriptorSets {
 		std::vector<VkDescriptorSet> objects;
@@ -32,12 +31,17 @@ public:
 	struct DescriptorSetLayouts {
 		VkDescriptorSetLayout terrain;
 		VkDescriptorSetLayout object;
+		VkDescriptorSetLayout waves; //written by the wave compute pass, sampled by the water
+		VkDescriptorSetLayout terrainTile; //height, normal and min/max textures of one streamed terrain tile
+		VkDescriptorSetLayout terrainDerive; //heights in, normal and min/max levels out for the terrain compute passes
+		VkDescriptorSetLayout culling; //objects and depth pyramid in, indirect commands, visible instances and counters out for the culling pass
+		VkDescriptorSetLayout depthPyramid; //one level in, the next one out for the depth pyramid reduction
 	};
 	static DescriptorSetLayouts descriptorSetLayouts;
 private:
 	Device& device;
 
-	VkDescriptorPool descriptorPool;
+	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 	VkSampler textureSampler;
 
 	void createDescriptorSetLayouts();
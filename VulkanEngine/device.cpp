@@ -6,6 +6,8 @@
 
 #include "spdlog/spdlog.h"
 
+#include "uploadManager.h"
+
 // local callback functions
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -59,10 +61,14 @@ Device::Device(Window &window) : window{window} {
 	createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
+	allocator_ = std::make_unique<MemoryAllocator>(device_, physicalDevice);
 	createCommandPool();
+	uploader_ = std::make_unique<UploadManager>(*this);
 }
 
 Device::~Device() {
+	uploader_.reset();
+	allocator_.reset();
 	vkDestroyCommandPool(device_, commandPool, nullptr);
 	vkDestroyDevice(device_, nullptr);
 
@@ -70,7 +76,9 @@ Device::~Device() {
 		DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 	}
 
-	vkDestroySurfaceKHR(instance, surface_, nullptr);
+	if (surface_ != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(instance, surface_, nullptr);
+	}
 	vkDestroyInstance(instance, nullptr);
 }
 
@@ -148,6 +156,9 @@ void Device::createLogicalDevice() {
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+	if (indices.transferFamilyHasValue) {
+		uniqueQueueFamilies.insert(indices.transferFamily);
+	}
 
 	float queuePriority = 1.0f;
 	for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -187,6 +198,12 @@ void Device::createLogicalDevice() {
 
 	vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
 	vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+	if (indices.transferFamilyHasValue) {
+		vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+	}
+	else {
+		transferQueue_ = graphicsQueue_;
+	}
 }
 
 void Device::createCommandPool() {
@@ -205,6 +222,9 @@ void Device::createCommandPool() {
 }
 
 void Device::createSurface() { 
+	if (Settings::headless) {
+		return;
+	}
 	window.createWindowSurface(instance, &surface_); 
 }
 
@@ -213,8 +233,8 @@ bool Device::isDeviceSuitable(VkPhysicalDevice device) {
 
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-	bool swapChainAdequate = false;
-	if (extensionsSupported) {
+	bool swapChainAdequate = Settings::headless;
+	if (extensionsSupported && !Settings::headless) {
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 	}
@@ -274,11 +294,13 @@ void Device::setupDebugMessenger() {
 }
 
 std::vector<const char *> Device::getRequiredExtensions() {
-	uint32_t glfwExtensionCount = 0;
-	const char **glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-	std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	std::vector<const char *> extensions;
+	if (!Settings::headless) {
+		uint32_t glfwExtensionCount = 0;
+		const char **glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
 
 	if (enableValidationLayers) {
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -342,19 +364,31 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
 
 	int i = 0;
 	for (const auto &queueFamily : queueFamilies) {
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && !indices.graphicsFamilyHasValue) {
 			indices.graphicsFamily = i;
 			indices.graphicsFamilyHasValue = true;
 		}
 
+		//offscreen frames are only ever read back on the graphics queue
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-		if (queueFamily.queueCount > 0 && presentSupport) {
+		if (Settings::headless) {
+			presentSupport = indices.graphicsFamilyHasValue && indices.graphicsFamily == i;
+		}
+		else {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+		}
+		if (queueFamily.queueCount > 0 && presentSupport && !indices.presentFamilyHasValue) {
 			indices.presentFamily = i;
 			indices.presentFamilyHasValue = true;
 		}
-		if (indices.isComplete()) {
-			break;
+
+		//a transfer only family maps to the copy engine, prefer it over one that also does compute
+		bool transferOnly = !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT &&
+			!(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+			(!indices.transferFamilyHasValue || transferOnly)) {
+			indices.transferFamily = i;
+			indices.transferFamilyHasValue = true;
 		}
 
 		i++;
@@ -420,7 +454,7 @@ uint32_t Device::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags prope
 	throw std::runtime_error("findMemoryType");
 }
 
-void Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory) { VkBufferCreateInfo bufferInfo{};
+void Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, Allocation &allocation) { VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size;
 	bufferInfo.usage = usage;
@@ -434,17 +468,17 @@ void Device::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryP
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+	allocation = allocator_->allocate(memRequirements, findMemoryType(memRequirements.memoryTypeBits, properties), true);
 
-	if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		spdlog::critical("Failed to allocate vertex buffer memory");
+	if (vkBindBufferMemory(device_, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+		spdlog::critical("Failed to bind buffer memory");
 		throw std::runtime_error("createBuffer");
 	}
+}
 
-	vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+void Device::destroyBuffer(VkBuffer buffer, Allocation &allocation) {
+	vkDestroyBuffer(device_, buffer, nullptr);
+	allocator_->free(allocation);
 }
 
 VkCommandBuffer Device::beginSingleTimeCommands() {
@@ -518,7 +552,7 @@ void Device::copyBufferToImage(
 	endSingleTimeCommands(commandBuffer);
 }
 
-void Device::createImageWithInfo(const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory) {
+void Device::createImageWithInfo(const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties, VkImage &image, Allocation &allocation) {
 	if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS) {
 		spdlog::critical("Failed to create image");
 		throw std::runtime_error("createImageWithInfo");
@@ -527,22 +561,21 @@ void Device::createImageWithInfo(const VkImageCreateInfo &imageInfo, VkMemoryPro
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+	allocation = allocator_->allocate(memRequirements,
+		findMemoryType(memRequirements.memoryTypeBits, properties),
+		imageInfo.tiling == VK_IMAGE_TILING_LINEAR);
 
-	if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-		spdlog::critical("Failed to allocate image memory");
-		throw std::runtime_error("createImageWithInfo");
-	}
-
-	if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS) {
+	if (vkBindImageMemory(device_, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
 		spdlog::critical("Failed to bind image memory");
 		throw std::runtime_error("createImageWithInfo");
 	}
 }
 
+void Device::destroyImage(VkImage image, Allocation &allocation) {
+	vkDestroyImage(device_, image, nullptr);
+	allocator_->free(allocation);
+}
+
 bool Device::supportsBlit(VkPhysicalDevice device) {
 	bool supportsBlit = true;
 	VkFormatProperties formatProps;
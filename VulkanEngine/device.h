@@ -1,11 +1,15 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "memoryAllocator.h"
 #include "settings.h"
 #include "window.h"
 
+class UploadManager;
+
 struct SwapChainSupportDetails {
   VkSurfaceCapabilitiesKHR capabilities;
   std::vector<VkSurfaceFormatKHR> formats;
@@ -15,8 +19,10 @@ struct SwapChainSupportDetails {
 struct QueueFamilyIndices {
   uint32_t graphicsFamily;
   uint32_t presentFamily;
+  uint32_t transferFamily; //only set for a transfer family without graphics
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
+  bool transferFamilyHasValue = false;
   bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
 };
 
@@ -38,6 +44,9 @@ public:
 	VkSurfaceKHR surface() { return surface_; }
 	VkQueue graphicsQueue() { return graphicsQueue_; }
 	VkQueue presentQueue() { return presentQueue_; }
+	//falls back to the graphics queue when the device has no dedicated transfer family
+	VkQueue transferQueue() { return transferQueue_; }
+	bool hasDedicatedTransferQueue() { return transferQueue_ != graphicsQueue_; }
 
 	SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -52,7 +61,8 @@ public:
 	  VkBufferUsageFlags usage,
 	  VkMemoryPropertyFlags properties,
 	  VkBuffer &buffer,
-	  VkDeviceMemory &bufferMemory);
+	  Allocation &allocation);
+	void destroyBuffer(VkBuffer buffer, Allocation &allocation);
 	VkCommandBuffer beginSingleTimeCommands();
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -63,7 +73,11 @@ public:
 	  const VkImageCreateInfo &imageInfo,
 	  VkMemoryPropertyFlags properties,
 	  VkImage &image,
-	  VkDeviceMemory &imageMemory);
+	  Allocation &allocation);
+	void destroyImage(VkImage image, Allocation &allocation);
+
+	MemoryAllocator &allocator() { return *allocator_; }
+	UploadManager &uploader() { return *uploader_; }
 
 	VkPhysicalDeviceProperties properties;
 
@@ -75,12 +89,17 @@ private:
 	VkCommandPool commandPool;
 
 	VkDevice device_;
-	VkSurfaceKHR surface_;
+	VkSurfaceKHR surface_ = VK_NULL_HANDLE;
 	VkQueue graphicsQueue_;
 	VkQueue presentQueue_;
+	VkQueue transferQueue_;
+	std::unique_ptr<MemoryAllocator> allocator_;
+	std::unique_ptr<UploadManager> uploader_;
 
 	const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
-	const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+	//headless rendering has nothing to present to, so it does not need VK_KHR_swapchain
+	const std::vector<const char *> deviceExtensions = Settings::headless ?
+		std::vector<const char *>{} : std::vector<const char *>{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
 	void createInstance();
 	void setupDebugMessenger();
@@ -5,6 +5,7 @@
 #include <thread>
 #include <math.h>
 #include <csignal>
+#include <algorithm>
 
 #include "spdlog/spdlog.h"
 
@@ -36,6 +37,7 @@
 #include "pythonManager.h"
 #include "assetManager.h"
 #include "constants.h"
+#include "uploadManager.h"
 
 
 std::vector<GameObject> Engine::gameObjects;
@@ -47,6 +49,12 @@ bool Engine::reloadBuffers = false;
 std::mutex Engine::mtx; 
 std::vector<std::vector<char*>> Engine::curImage;
 std::atomic<bool> Engine::takeImage = false;
+AllocatorStats Engine::memoryStats;
+RenderManager::CullingStats Engine::cullingStats;
+SceneTree Engine::sceneTree;
+std::unique_ptr<WaterSurface> Engine::water;
+std::unique_ptr<WaveSimulation> Engine::waves;
+std::unique_ptr<Terrain> Engine::terrain;
 
 Engine::Engine() {
 	loadGameObjects();
@@ -56,11 +64,12 @@ Engine::Engine() {
 }
 
 Engine::~Engine() {
-	for (size_t i = 0; i < uniformBuffers.size(); i++) {
-        vkDestroyBuffer(device.device(), uniformBuffers[i], nullptr);
-        vkFreeMemory(device.device(), uniformBuffersMemory[i], nullptr);
-    }
+	//evicted terrain tiles are freed from the terrain's pool, so their deleters have to run before it goes
+	renderer.flushPendingDestroys();
 	gameObjects.clear();
+	water.reset();
+	waves.reset();
+	terrain.reset();
 	AssetManager::clearModels();
 	AssetManager::clearTextures();
 }
@@ -68,6 +77,8 @@ Engine::~Engine() {
 void Engine::addModel() {
 	AssetManager::loadTexture(device, modelTexture, modelTexture);
 	AssetManager::loadModel(device, modelToAdd, modelFilepath, modelTexture); 
+	//no need to wait, the next frame is submitted to the same queue after the upload
+	device.uploader().submit();
 	modelToAdd = "";
 	modelFilepath = "";
 	modelTexture = "";
@@ -143,7 +154,7 @@ void Engine::getCurrentImage() {
 		srcImage,
 		VK_ACCESS_MEMORY_READ_BIT,
 		VK_ACCESS_TRANSFER_READ_BIT,
-		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		renderer.getFinalLayout(),
 		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 		VK_PIPELINE_STAGE_TRANSFER_BIT,
 		VK_PIPELINE_STAGE_TRANSFER_BIT,
@@ -205,7 +216,7 @@ void Engine::getCurrentImage() {
 		VK_ACCESS_TRANSFER_READ_BIT,
 		VK_ACCESS_MEMORY_READ_BIT,
 		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		renderer.getFinalLayout(),
 		VK_PIPELINE_STAGE_TRANSFER_BIT,
 		VK_PIPELINE_STAGE_TRANSFER_BIT,
 		VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
@@ -273,73 +284,62 @@ void Engine::getCurrentImage() {
 
 
 void Engine::updateBuffers() {
-	uniformBuffers.resize(gameObjects.size());
-    uniformBuffersMemory.resize(gameObjects.size());
-	size_t bufferSize;
-    for (size_t i = 0; i < gameObjects.size(); i++) {
-		if (gameObjects[i].getTag() == "skybox") {
-			bufferSize = sizeof(Constants::CubeMapUBO);
-		}
-		else if (gameObjects[i].getTag() == "terrain") {
-			bufferSize = sizeof(Constants::TesselationUBO);
-		}
-		else {
-			bufferSize = sizeof(Constants::ObjectUBO);
-		}
-
-		device.createBuffer(bufferSize,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-			uniformBuffers[i], 
-			uniformBuffersMemory[i]);
+	//frames still in flight read the old ring and descriptor sets, retire them instead of freeing
+	if (uniformBuffer) {
+		std::shared_ptr<Buffer> retiredBuffer = std::move(uniformBuffer);
+		renderer.deferDestroy([retiredBuffer]() mutable { retiredBuffer.reset(); });
+	}
+	VkDescriptorPool retiredPool = descriptorManager.releaseDescriptorPool();
+	if (retiredPool != VK_NULL_HANDLE) {
+		VkDevice vkDevice = device.device();
+		renderer.deferDestroy([vkDevice, retiredPool]() { vkDestroyDescriptorPool(vkDevice, retiredPool, nullptr); });
+	}
 
-    }
+	//every slot is sized for the largest ubo so any object can use any slot
+	VkDeviceSize uboSize = std::max({ 
+		sizeof(Constants::ObjectUBO), 
+		sizeof(Constants::CubeMapUBO), 
+		sizeof(Constants::TesselationUBO) });
+	uniformBuffer = std::make_unique<Buffer>(
+		device,
+		uboSize,
+		static_cast<uint32_t>(gameObjects.size() * Swapchain::MAX_FRAMES_IN_FLIGHT),
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		device.properties.limits.minUniformBufferOffsetAlignment);
+	uniformBuffer->map();
 
 	descriptorManager.createDescriptorPool(static_cast<uint32_t>(gameObjects.size() * 2));
 	descriptorManager.createDescriptorSets(static_cast<uint32_t>(gameObjects.size() * 2));
 
 	//spdlog::debug("{}", gameObjects.size());
 
+	//all sets point at slot 0, the dynamic offset selects frame and object at bind time
+	VkDescriptorBufferInfo bufferInfo = uniformBuffer->descriptorInfoForIndex(0);
 	for (size_t i = 0; i < gameObjects.size(); i++) {
-		if (gameObjects[i].getTag() == "skybox") {
-			bufferSize = sizeof(Constants::CubeMapUBO);
-			descriptorManager.updateObjectDescriptorSet(
-				gameObjects[i],
-				bufferSize,
-				DescriptorManager::descriptorSets.objects[i],
-				uniformBuffers[i],
-				gameObjects[i].model->getTexture()->getImageView());
-		}
-		else if (gameObjects[i].getTag() == "terrain") {
-			bufferSize = sizeof(Constants::TesselationUBO);
+		if (gameObjects[i].getTag() == "terrain") {
 			descriptorManager.updateTerrainDescriptorSet(
 				gameObjects[i],
-				bufferSize,
+				bufferInfo,
 				DescriptorManager::descriptorSets.terrain,
-				uniformBuffers[i],
-				AssetManager::textures["heightmap"]->getImageView(),
 				gameObjects[i].model->getTexture()->getImageView());
 		}
 		else {
-			bufferSize = sizeof(Constants::ObjectUBO);
 			descriptorManager.updateObjectDescriptorSet(
 				gameObjects[i],
-				bufferSize,
+				bufferInfo,
 				DescriptorManager::descriptorSets.objects[i],
-				uniformBuffers[i],
 				gameObjects[i].model->getTexture()->getImageView());
 		}
-
 	}
 }
 
 void Engine::loadGameObjects() {
-	AssetManager::loadTexture(device, "models/backpack/diffuse.jpg", "backpack", true);
-	AssetManager::loadTexture(device, "textures/camel.jpg", "camel");
-	AssetManager::loadTexture(device, "textures/heightmap.png", "heightmap");
-	//AssetManager::loadTexture(device, "textures/apple.jpg", "apple");
-	AssetManager::loadTexture(device, "textures/sand.jpg", "sand");
-	AssetManager::loadTexture(device, "models/rock/rock.tga", "rock");
+	AssetManager::queueTexture("models/backpack/diffuse.jpg", "backpack", true);
+	AssetManager::queueTexture("textures/camel.jpg", "camel");
+	//AssetManager::queueTexture("textures/apple.jpg", "apple");
+	AssetManager::queueTexture("textures/sand.jpg", "sand");
+	AssetManager::queueTexture("models/rock/rock.tga", "rock");
 	std::array<std::string, 6> filepaths = {
 		"textures/skybox4/right.png",
 		"textures/skybox4/left.png",
@@ -348,12 +348,14 @@ void Engine::loadGameObjects() {
 		"textures/skybox4/front.png",
 		"textures/skybox4/back.png"
 	};
-	AssetManager::loadCubeMap(device, filepaths, "skybox");
+	AssetManager::queueCubeMap(filepaths, "skybox");
 
-	AssetManager::loadModel(device, "backpack", "models/backpack/backpack.obj", "backpack"); 
-	AssetManager::loadModel(device, "rock", "models/rock/rock.obj", "rock"); 
-	//AssetManager::loadModel(device, "apple", "models/apple.obj", "apple"); 
-	AssetManager::loadModel(device, "skybox", "models/textured_cube.obj", "skybox"); 
+	AssetManager::queueModel("backpack", "models/backpack/backpack.obj", "backpack"); 
+	AssetManager::queueModel("rock", "models/rock/rock.obj", "rock", Model::VertexFormat::Packed); 
+	//AssetManager::queueModel("apple", "models/apple.obj", "apple"); 
+	AssetManager::queueModel("skybox", "models/textured_cube.obj", "skybox"); 
+
+	AssetManager::finishLoading(device);
 
 	auto gameObj = GameObject::createGameObject("backpack");
 	gameObj.model = AssetManager::models["backpack"];
@@ -361,15 +363,28 @@ void Engine::loadGameObjects() {
 	gameObj.transform.scale = glm::vec3(0.5f);
 	gameObjects.push_back(std::move(gameObj));
 
+	//the water object only places the clipmap vertically, the rings follow the camera
+	water = std::make_unique<WaterSurface>(device, AssetManager::textures["skybox"]);
+	waves = std::make_unique<WaveSimulation>(device);
 	auto gameObj1 = GameObject::createGameObject("water");
-	gameObj1.model = Model::generateMesh(device, 1600, 1600, AssetManager::textures["skybox"]);
-	gameObj1.transform.scale = glm::vec3(0.1f);
-	gameObj1.transform.translation = glm::vec3(-75, 1, -75);
+	gameObj1.model = water->getModel();
+	gameObj1.transform.translation = glm::vec3(0, 1, 0);
+	gameObj1.transform.rotation = glm::vec3(0.f);
 	gameObjects.push_back(std::move(gameObj1));
 
+	//the heightmap is cut into tiles that are only uploaded once the camera gets close,
+	//a streamed map points tilePath at one file per tile instead, e.g. "terrain/tile_{x}_{z}.png"
+	Terrain::TerrainInfo terrainInfo{};
+	terrainInfo.tilePath = "textures/heightmap.png";
+	terrainInfo.tilesX = 4;
+	terrainInfo.tilesZ = 4;
+	terrainInfo.tileSize = 64.f;
+	terrainInfo.heightScale = 20.f;
+	terrain = std::make_unique<Terrain>(device, renderer, AssetManager::textures["sand"], terrainInfo);
 	auto gameObj4 = GameObject::createGameObject("terrain");
-	gameObj4.model = Model::generateTerrain(device, 64, 1.f);
-	gameObj4.transform.translation = glm::vec3(0, 2, 0);
+	gameObj4.model = terrain->getModel();
+	glm::vec2 terrainExtent = terrain->getExtent();
+	gameObj4.transform.translation = glm::vec3(-terrainExtent.x / 2, 2, -terrainExtent.y / 2);
 	gameObjects.push_back(std::move(gameObj4));
 
 	auto gameObj5 = GameObject::createGameObject("rock");
@@ -395,33 +410,48 @@ void Engine::loadGameObjects() {
 
 	lightPos = glm::vec3(120, 30, 250);
 
+	//generated meshes go to the gpu in one batch
+	device.uploader().wait(device.uploader().submit());
+
 	updateBuffers();
+
+	memoryStats = device.allocator().getStats();
+	spdlog::info("GPU memory: {} allocations in {} blocks, {:.1f}/{:.1f} MB used",
+		memoryStats.allocationCount,
+		memoryStats.blockCount,
+		memoryStats.bytesUsed / (1024.0 * 1024.0),
+		memoryStats.bytesReserved / (1024.0 * 1024.0));
 }
 
 
 void Engine::render() {
-	glfwPollEvents();
-	auto commandBuffer = renderer.beginFrame();
-	if (commandBuffer && !reloadBuffers) {
-		//Engine::mtx.lock();
-		//if (reloadBuffers == true) {
-			//updateBuffers();
-			//reloadBuffers = false;
-		//}
-		//else {
-			renderer.beginSwapChainRenderPass(commandBuffer);
-			renderManager.renderGameObjects(commandBuffer, gameObjects, camera, uniformBuffersMemory);
-			renderer.endSwapChainRenderPass(commandBuffer);
-			renderer.endFrame();
-		//}
-		//Engine::mtx.unlock();
-	}
+	window.pollEvents();
+
+	//python may add objects from its own thread while a frame is recorded
+	std::lock_guard<std::mutex> lock(Engine::mtx);
 	if (reloadBuffers == true) {
-		Engine::mtx.lock();
 		updateBuffers();
 		reloadBuffers = false;
-		Engine::mtx.unlock();
-		//updateBuffers();
+	}
+	//moves the objects python or the update loop have transformed since the last frame
+	sceneTree.sync(gameObjects);
+
+	//flush anything recorded since the last frame and release finished staging memory
+	device.uploader().submit();
+
+	auto commandBuffer = renderer.beginFrame();
+	if (commandBuffer) {
+		FrameInfo frameInfo{ renderer.getFrameIndex(), commandBuffer, camera, *uniformBuffer };
+		//compute work has to be recorded before the render pass begins
+		waves->update(commandBuffer, frameInfo.frameIndex, static_cast<float>(Window::getTime()));
+		terrain->prepare(commandBuffer, frameInfo.frameIndex);
+		renderManager.prepare(frameInfo, gameObjects);
+		cullingStats = renderManager.getCullingStats();
+		renderer.beginSwapChainRenderPass(commandBuffer);
+		renderManager.renderGameObjects(frameInfo, gameObjects);
+		renderer.endSwapChainRenderPass(commandBuffer);
+		renderManager.buildDepthPyramid(frameInfo, renderer.getCurrentDepthImageView(), renderer.getSwapChainExtent());
+		renderer.endFrame();
 	}
 }
 
@@ -469,14 +499,14 @@ void Engine::run() {
 	InputManager::yoffset = 0;
 	camera.rotateCamera(-90, 0, 1);
 
-	double lastTime = glfwGetTime(), timer = lastTime;
+	double lastTime = Window::getTime(), timer = lastTime, startTime = lastTime;
 	double deltaTime = 0, nowTime = 0;
-	int frames = 0, updates = 0;
+	int frames = 0, updates = 0, totalFrames = 0;
 	const double delta = 1.0 / 120.0;
 
 	while (!window.shouldClose()) {
 		//get time
-		nowTime = glfwGetTime();
+		nowTime = Window::getTime();
 		deltaTime += (nowTime - lastTime) / delta;
 		lastTime = nowTime;
 
@@ -489,16 +519,27 @@ void Engine::run() {
 
 		render();
 		frames++;
+		totalFrames++;
+		if (Settings::maxFrames > 0 && totalFrames >= Settings::maxFrames) {
+			shutdown();
+		}
 
 		//reset and output fps
-		if (glfwGetTime() - timer > 1.0) {
+		if (Window::getTime() - timer > 1.0) {
 			timer++;
 			//std::cout << "FPS: " << frames << " Updates:" << updates << std::endl;
 			updates = 0, frames = 0;
+			AllocatorStats stats = device.allocator().getStats();
+			//python reads it from its own thread
+			std::lock_guard<std::mutex> lock(Engine::mtx);
+			memoryStats = stats;
 		}
 	}
 
 	vkDeviceWaitIdle(device.device());
+
+	double elapsed = Window::getTime() - startTime;
+	spdlog::info("Rendered {} frames in {:.2f}s ({:.1f} fps)", totalFrames, elapsed, totalFrames / elapsed);
 }
 
 //eventually should handle all shutdown procedures
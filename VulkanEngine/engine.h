@@ -11,12 +11,17 @@
 #include "camera.h"
 #include "renderManager.h"
 #include "descriptorManager.h"
+#include "buffer.h"
+#include "waterSurface.h"
+#include "waveSimulation.h"
+#include "terrain.h"
+#include "sceneTree.h"
 //#include "model.h"
 
 class Engine {
 public:
-	int width = 800;
-	int height = 600;
+	int width = Settings::width;
+	int height = Settings::height;
 
 	static std::vector<GameObject> gameObjects;
 	static glm::vec3 lightPos;
@@ -41,17 +46,22 @@ public:
 	static std::string modelTexture;
 	static std::vector<std::vector<char*>> curImage;
 	static std::atomic<bool> takeImage;
+	static AllocatorStats memoryStats; //refreshed once a second for python
+	static RenderManager::CullingStats cullingStats; //refreshed every frame for python
+	static SceneTree sceneTree; //bounds of gameObjects, synced at the start of every frame
+	static std::unique_ptr<WaterSurface> water;
+	static std::unique_ptr<WaveSimulation> waves;
+	static std::unique_ptr<Terrain> terrain;
 private:
 	Window window{width, height, "Vulkan"};
 	Device device{ window };
 	Renderer renderer{ window, device };
 	DescriptorManager descriptorManager{ device };
-	RenderManager renderManager{ device, renderer.getSwapChainRenderPass() };
+	RenderManager renderManager{ device, renderer, renderer.getSwapChainRenderPass() };
     Camera camera{};
 
-	std::vector<VkBuffer> uniformBuffers; //TOOD: rework to use buffer class
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
-	
+	//persistently mapped ring, one region per frame in flight with a slot per game object
+	std::unique_ptr<Buffer> uniformBuffer;
 
 	void loadGameObjects();
 	void updateBuffers();
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "camera.h"
+#include "buffer.h"
+
+//everything recorded for one frame in flight, frameIndex selects its uniform region
+struct FrameInfo {
+	int frameIndex;
+	VkCommandBuffer commandBuffer;
+	const Camera& camera;
+	Buffer& uniformBuffer;
+};
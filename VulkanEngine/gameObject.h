@@ -7,6 +7,7 @@
 
 #include "model.h"
 
+//changes to objects in Engine::gameObjects have to be followed by Engine::sceneTree.markMoved
 struct TransformComponent {
 	glm::vec3 translation{};
 	glm::vec3 scale{ 1.f, 1.f, 1.f };
@@ -0,0 +1,317 @@
+#include "gpuCulling.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "spdlog/spdlog.h"
+
+#include "descriptorManager.h"
+
+static constexpr uint32_t workgroupSize = 64;
+
+//cull.comp reads the structs with std430 rules
+static_assert(sizeof(GpuCulling::Record) == 128, "Record has to match cull.comp");
+static_assert(sizeof(Model::Instance) == 112, "Instance has to match cull.comp");
+
+GpuCulling::GpuCulling(Device& device) : device{ device } {
+	uniformBuffer = std::make_unique<Buffer>(
+		device,
+		sizeof(Constants::CullUBO),
+		Swapchain::MAX_FRAMES_IN_FLIGHT,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		device.properties.limits.minUniformBufferOffsetAlignment);
+	uniformBuffer->map();
+
+	for (Frame& frame : frames) {
+		frame.counters = std::make_unique<Buffer>(
+			device,
+			sizeof(Counters),
+			1,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		frame.counters->map();
+		Counters zero{};
+		frame.counters->writeToBuffer(&zero, sizeof(zero));
+	}
+
+	createDescriptorSets();
+	createPipeline();
+	for (int i = 0; i < Swapchain::MAX_FRAMES_IN_FLIGHT; i++) {
+		reserve(i, 1, 1);
+	}
+}
+
+GpuCulling::~GpuCulling() {
+	pipeline.reset();
+	vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+	vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
+}
+
+uint32_t GpuCulling::grow(uint32_t capacity, uint32_t required) {
+	capacity = std::max(capacity, 256u);
+	while (capacity < required) {
+		capacity *= 2;
+	}
+	return capacity;
+}
+
+void GpuCulling::markRecords(const std::vector<uint32_t>& changed) {
+	for (Frame& frame : frames) {
+		frame.pendingRecords.insert(frame.pendingRecords.end(), changed.begin(), changed.end());
+	}
+}
+
+void GpuCulling::markAllRecords() {
+	for (Frame& frame : frames) {
+		frame.pendingRecords.clear();
+		frame.pendingAllRecords = true;
+	}
+}
+
+void GpuCulling::reserve(int frameIndex, uint32_t instanceCount, uint32_t commandCount) {
+	Frame& frame = frames[frameIndex];
+	bool changed = false;
+
+	//a new record buffer starts out as a full copy, otherwise only the records marked since this frame last ran are copied
+	const uint32_t recordCount = static_cast<uint32_t>(records.size());
+	if (!frame.records || frame.records->getInstanceCount() < recordCount) {
+		uint32_t capacity = grow(frame.records ? frame.records->getInstanceCount() : 0, recordCount);
+		frame.records = std::make_unique<Buffer>(
+			device,
+			sizeof(Record),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		frame.records->map();
+		frame.pendingAllRecords = true;
+		changed = true;
+	}
+	if (frame.pendingAllRecords) {
+		if (recordCount > 0) {
+			frame.records->writeToBuffer(records.data(), recordCount * sizeof(Record));
+		}
+	}
+	else {
+		for (uint32_t record : frame.pendingRecords) {
+			if (record < recordCount) {
+				frame.records->writeToIndex(&records[record], record, sizeof(Record));
+			}
+		}
+	}
+	frame.pendingRecords.clear();
+	frame.pendingAllRecords = false;
+
+	//every object may be visible, so each model's range has room for all of its objects
+	if (!frame.instances || frame.instances->getInstanceCount() < instanceCount) {
+		uint32_t capacity = grow(frame.instances ? frame.instances->getInstanceCount() : 0, instanceCount);
+		frame.instances = std::make_unique<Buffer>(
+			device,
+			sizeof(Model::Instance),
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		changed = true;
+	}
+
+	if (!frame.commands || frame.commands->getInstanceCount() < commandCount) {
+		uint32_t capacity = grow(frame.commands ? frame.commands->getInstanceCount() : 0, commandCount);
+		frame.commandTemplates = std::make_unique<Buffer>(
+			device,
+			commandStride,
+			capacity,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		frame.commandTemplates->map();
+		//the shader bumps the instance counts and the indirect draws read them, the templates are copied in every frame
+		frame.commands = std::make_unique<Buffer>(
+			device,
+			commandStride,
+			capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		changed = true;
+	}
+
+	//the frame's set isn't used by any pending submission, so it can be rewritten in place
+	if (changed) {
+		updateDescriptorSet(frameIndex);
+	}
+}
+
+GpuCulling::Counters GpuCulling::collectCounters(int frameIndex) {
+	Counters counters = *static_cast<Counters*>(frames[frameIndex].counters->getMappedMemory());
+	Counters zero{};
+	frames[frameIndex].counters->writeToBuffer(&zero, sizeof(zero));
+	return counters;
+}
+
+void GpuCulling::cull(VkCommandBuffer commandBuffer, int frameIndex, uint32_t commandCount, const Constants::Frustum& frustum, const DepthPyramid& depthPyramid) {
+	if (commandCount == 0) {
+		return;
+	}
+	Frame& frame = frames[frameIndex];
+	const uint32_t recordCount = static_cast<uint32_t>(records.size());
+
+	Constants::CullUBO ubo{};
+	std::memcpy(ubo.frustumPlanes, frustum.planes.data(), sizeof(ubo.frustumPlanes));
+	ubo.occlusionViewProj = depthPyramid.getViewProj();
+	ubo.pyramid = glm::vec4(
+		static_cast<float>(depthPyramid.getDepthExtent().width),
+		static_cast<float>(depthPyramid.getDepthExtent().height),
+		static_cast<float>(depthPyramid.getLevelCount()),
+		depthPyramid.isValid() ? 1.f : 0.f);
+	ubo.recordCount = recordCount;
+	uniformBuffer->writeToIndex(&ubo, frameIndex, sizeof(ubo));
+
+	//the pyramid is recreated when the window resizes, so its binding is written every frame
+	VkDescriptorImageInfo pyramidInfo = depthPyramid.getDescriptorInfo();
+	VkWriteDescriptorSet pyramidWrite{};
+	pyramidWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	pyramidWrite.dstSet = frame.descriptorSet;
+	pyramidWrite.dstBinding = 4;
+	pyramidWrite.dstArrayElement = 0;
+	pyramidWrite.descriptorCount = 1;
+	pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pyramidWrite.pImageInfo = &pyramidInfo;
+	vkUpdateDescriptorSets(device.device(), 1, &pyramidWrite, 0, nullptr);
+
+	//host writes of the records and command templates are visible to the queue once it is submitted
+	//the frame's last indirect draws finished with its fence, so the commands can be overwritten right away
+	VkBufferCopy copyRegion{};
+	copyRegion.size = commandCount * commandStride;
+	vkCmdCopyBuffer(commandBuffer, frame.commandTemplates->getBuffer(), frame.commands->getBuffer(), 1, &copyRegion);
+
+	VkBufferMemoryBarrier copyBarrier{};
+	copyBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	copyBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	copyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	copyBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	copyBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	copyBarrier.buffer = frame.commands->getBuffer();
+	copyBarrier.offset = 0;
+	copyBarrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr,
+		1, &copyBarrier,
+		0, nullptr);
+
+	pipeline->bind(commandBuffer);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+	vkCmdDispatch(commandBuffer, (recordCount + workgroupSize - 1) / workgroupSize, 1, 1);
+
+	std::array<VkBufferMemoryBarrier, 2> barriers{};
+	for (auto& barrier : barriers) {
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+	}
+	barriers[0].buffer = frame.commands->getBuffer();
+	barriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	barriers[1].buffer = frame.instances->getBuffer();
+	barriers[1].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		0, 0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data(),
+		0, nullptr);
+
+	//read back by collectCounters once the frame's fence has been waited on
+	VkBufferMemoryBarrier counterBarrier = barriers[0];
+	counterBarrier.buffer = frame.counters->getBuffer();
+	counterBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT,
+		0, 0, nullptr,
+		1, &counterBarrier,
+		0, nullptr);
+}
+
+void GpuCulling::createDescriptorSets() {
+	const uint32_t setCount = Swapchain::MAX_FRAMES_IN_FLIGHT;
+	std::array<VkDescriptorPoolSize, 3> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[0].descriptorCount = setCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = setCount * 4;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[2].descriptorCount = setCount;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = setCount;
+
+	if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+		spdlog::critical("Failed to create culling descriptor pool");
+		throw std::runtime_error("createDescriptorSets");
+	}
+
+	std::array<VkDescriptorSetLayout, Swapchain::MAX_FRAMES_IN_FLIGHT> layouts;
+	layouts.fill(DescriptorManager::descriptorSetLayouts.culling);
+	std::array<VkDescriptorSet, Swapchain::MAX_FRAMES_IN_FLIGHT> descriptorSets;
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = setCount;
+	allocInfo.pSetLayouts = layouts.data();
+
+	if (vkAllocateDescriptorSets(device.device(), &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+		spdlog::critical("Failed to allocate culling descriptor sets");
+		throw std::runtime_error("createDescriptorSets");
+	}
+	for (uint32_t i = 0; i < setCount; i++) {
+		frames[i].descriptorSet = descriptorSets[i];
+	}
+}
+
+void GpuCulling::updateDescriptorSet(int frameIndex) {
+	Frame& frame = frames[frameIndex];
+	//binding 4 is the depth pyramid, written by cull
+	std::array<VkDescriptorBufferInfo, 5> bufferInfos = {
+		uniformBuffer->descriptorInfoForIndex(frameIndex),
+		frame.records->descriptorInfo(),
+		frame.commands->descriptorInfo(),
+		frame.instances->descriptorInfo(),
+		frame.counters->descriptorInfo(),
+	};
+	std::array<uint32_t, 5> bindings = { 0, 1, 2, 3, 5 };
+
+	std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
+	for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = frame.descriptorSet;
+		descriptorWrites[i].dstBinding = bindings[i];
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+
+	vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void GpuCulling::createPipeline() {
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &DescriptorManager::descriptorSetLayouts.culling;
+	pipelineLayoutInfo.pushConstantRangeCount = 0;
+
+	if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+		spdlog::critical("Failed to create pipeline layout");
+		throw std::runtime_error("createPipeline");
+	}
+
+	pipeline = std::make_unique<ComputePipeline>(device, "shaders/cull.spv", pipelineLayout);
+}
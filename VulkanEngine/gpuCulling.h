@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "glm/glm.hpp"
+
+#include "device.h"
+#include "buffer.h"
+#include "computePipeline.h"
+#include "constants.h"
+#include "model.h"
+#include "swapchain.h"
+#include "depthPyramid.h"
+
+//frustum and occlusion culls every instanced game object in a compute pass, occlusion against the previous frame's depth pyramid
+//surviving objects are compacted into their model's instance range and counted into its indirect command
+//so the cpu records one indirect draw per model and only touches the records of objects that moved
+class GpuCulling {
+public:
+	//records of objects that aren't drawn instanced, the pass skips them
+	static constexpr uint32_t noCommand = 0xffffffff;
+
+	//std430 layout of cull.comp, transform, bounds and draw of one game object, indexed like Engine::gameObjects
+	//kept between frames, only the records of moved objects are written again
+	struct Record {
+		glm::mat4 model;
+		glm::vec4 sphere; //mesh space center and radius
+		glm::vec4 boundsMin; //mesh space box
+		glm::vec4 boundsMax;
+		uint32_t command = noCommand; //indirect command of the object's model
+		uint32_t firstInstance = 0; //start of the model's range in the instance buffer
+		uint32_t padding[2];
+	};
+
+	//what the pass of one frame tested and rejected
+	struct Counters {
+		uint32_t tested = 0;
+		uint32_t frustumCulled = 0;
+		uint32_t occlusionCulled = 0;
+	};
+
+	//five uints, VkDrawIndexedIndirectCommand or VkDrawIndirectCommand padded to the same size
+	static constexpr VkDeviceSize commandStride = 5 * sizeof(uint32_t);
+
+	GpuCulling(Device& device);
+	~GpuCulling();
+
+	//delete copy constructors
+	GpuCulling(const GpuCulling&) = delete;
+	GpuCulling& operator=(const GpuCulling&) = delete;
+
+	//cpu copy of the records, resized to the object count before writing through getRecords
+	//written records have to be passed to markRecords so every frame's buffer picks them up
+	void resizeRecords(uint32_t count) { records.resize(count); }
+	Record* getRecords() { return records.data(); }
+	void markRecords(const std::vector<uint32_t>& changed);
+	//after the instance ranges have moved, every record is copied again
+	void markAllRecords();
+
+	//grows the frame's buffers and copies the records marked since it last ran, its previous submission has to have finished
+	//command templates are then written through the mapped pointer, the instance buffer holds instanceCount instances
+	void reserve(int frameIndex, uint32_t instanceCount, uint32_t commandCount);
+	uint32_t* getCommands(int frameIndex) const { return static_cast<uint32_t*>(frames[frameIndex].commandTemplates->getMappedMemory()); }
+
+	//has to be recorded outside of the render pass, before the indirect draws
+	//copies the commandCount templates into the device local commands first, which resets their instance counts
+	//tests every record, frustum holds the world space planes of the camera
+	void cull(VkCommandBuffer commandBuffer, int frameIndex, uint32_t commandCount, const Constants::Frustum& frustum, const DepthPyramid& depthPyramid);
+	//counters of the frame's last submission, which has finished, and clears them for the next one
+	Counters collectCounters(int frameIndex);
+
+	VkBuffer getCommandBuffer(int frameIndex) const { return frames[frameIndex].commands->getBuffer(); }
+	VkBuffer getInstanceBuffer(int frameIndex) const { return frames[frameIndex].instances->getBuffer(); }
+
+private:
+	struct Frame {
+		std::unique_ptr<Buffer> records;
+		std::vector<uint32_t> pendingRecords; //marked since the frame last ran, an object moving every frame shows up once per frame in flight
+		bool pendingAllRecords = false;
+		std::unique_ptr<Buffer> commandTemplates; //written by the cpu with zero instances
+		std::unique_ptr<Buffer> commands; //read by the indirect draws, only the gpu writes it
+		std::unique_ptr<Buffer> instances;
+		std::unique_ptr<Buffer> counters;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	};
+
+	Device& device;
+	std::array<Frame, Swapchain::MAX_FRAMES_IN_FLIGHT> frames;
+	std::unique_ptr<Buffer> uniformBuffer;
+	std::vector<Record> records;
+
+	VkDescriptorPool descriptorPool;
+	VkPipelineLayout pipelineLayout;
+	std::unique_ptr<ComputePipeline> pipeline;
+
+	void createDescriptorSets();
+	void createPipeline();
+	void updateDescriptorSet(int frameIndex);
+	static uint32_t grow(uint32_t capacity, uint32_t required);
+};
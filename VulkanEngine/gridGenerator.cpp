@@ -0,0 +1,110 @@
+#include "gridGenerator.h"
+
+#include <stdexcept>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "threadPool.h"
+
+namespace GridGenerator {
+	GridInfo ring(uint32_t level, uint32_t cellsPerSide, float baseCellSize) {
+		if (cellsPerSide % 4 != 0) {
+			spdlog::critical("Ring grids need a multiple of 4 cells per side, got {}", cellsPerSide);
+			throw std::runtime_error("ring");
+		}
+
+		GridInfo info{};
+		info.cellsX = cellsPerSide;
+		info.cellsZ = cellsPerSide;
+		info.cellSize = baseCellSize * static_cast<float>(1u << level);
+		info.origin = glm::vec2(-0.5f * cellsPerSide * info.cellSize);
+		if (level > 0) {
+			info.holeMin = glm::uvec2(cellsPerSide / 4);
+			info.holeMax = glm::uvec2(cellsPerSide * 3 / 4);
+		}
+		return info;
+	}
+
+	void generate(const GridInfo& info, Model::Geometry& geometry) {
+		const uint32_t verticesX = info.cellsX + 1;
+		const uint32_t verticesZ = info.cellsZ + 1;
+		const bool hasHole = info.holeMax.x > info.holeMin.x && info.holeMax.y > info.holeMin.y;
+
+		//vertex rows strictly inside the hole lose the vertices strictly inside it, cell rows inside it lose its cells
+		auto vertexRowInHole = [&](uint32_t z) { return hasHole && z > info.holeMin.y && z < info.holeMax.y; };
+		auto cellRowInHole = [&](uint32_t z) { return hasHole && z >= info.holeMin.y && z < info.holeMax.y; };
+		const uint32_t holeVertices = hasHole ? info.holeMax.x - info.holeMin.x - 1 : 0;
+		const uint32_t holeCells = hasHole ? info.holeMax.x - info.holeMin.x : 0;
+
+		//prefix sums so every row knows where it writes, which lets rows run in any order
+		std::vector<uint32_t> vertexRowStart(verticesZ + 1, 0);
+		for (uint32_t z = 0; z < verticesZ; z++) {
+			vertexRowStart[z + 1] = vertexRowStart[z] + verticesX - (vertexRowInHole(z) ? holeVertices : 0);
+		}
+		std::vector<size_t> indexRowStart(info.cellsZ + 1, 0);
+		for (uint32_t z = 0; z < info.cellsZ; z++) {
+			indexRowStart[z + 1] = indexRowStart[z] + 6 * static_cast<size_t>(info.cellsX - (cellRowInHole(z) ? holeCells : 0));
+		}
+
+		auto vertexIndex = [&](uint32_t x, uint32_t z) {
+			if (vertexRowInHole(z) && x >= info.holeMax.x) {
+				x -= holeVertices;
+			}
+			return vertexRowStart[z] + x;
+		};
+
+		geometry = Model::Geometry{};
+		geometry.vertices.resize(vertexRowStart[verticesZ]);
+		geometry.indices.resize(indexRowStart[info.cellsZ]);
+
+		auto writeVertexRow = [&](uint32_t z) {
+			Model::Vertex* out = geometry.vertices.data() + vertexRowStart[z];
+			bool inHole = vertexRowInHole(z);
+			for (uint32_t x = 0; x < verticesX; x++) {
+				if (inHole && x > info.holeMin.x && x < info.holeMax.x) {
+					continue;
+				}
+				out->position = glm::vec3(info.origin.x + x * info.cellSize, 0.f, info.origin.y + z * info.cellSize);
+				out->color = glm::vec3(1.f);
+				out->normal = glm::vec3(0.f, 1.f, 0.f);
+				out->texCoord = glm::vec2(static_cast<float>(x) / info.cellsX, static_cast<float>(z) / info.cellsZ);
+				out++;
+			}
+		};
+
+		auto writeIndexRow = [&](uint32_t z) {
+			uint32_t* out = geometry.indices.data() + indexRowStart[z];
+			bool inHole = cellRowInHole(z);
+			for (uint32_t x = 0; x < info.cellsX; x++) {
+				if (inHole && x >= info.holeMin.x && x < info.holeMax.x) {
+					continue;
+				}
+				uint32_t v00 = vertexIndex(x, z);
+				uint32_t v01 = vertexIndex(x, z + 1);
+				uint32_t v11 = vertexIndex(x + 1, z + 1);
+				uint32_t v10 = vertexIndex(x + 1, z);
+				//same winding as the old per quad generator
+				*out++ = v00;
+				*out++ = v01;
+				*out++ = v11;
+				*out++ = v11;
+				*out++ = v10;
+				*out++ = v00;
+			}
+		};
+
+		if (info.parallel) {
+			ThreadPool::global().parallelFor(verticesZ, writeVertexRow);
+			ThreadPool::global().parallelFor(info.cellsZ, writeIndexRow);
+		}
+		else {
+			for (uint32_t z = 0; z < verticesZ; z++) {
+				writeVertexRow(z);
+			}
+			for (uint32_t z = 0; z < info.cellsZ; z++) {
+				writeIndexRow(z);
+			}
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "glm/glm.hpp"
+
+#include "model.h"
+
+//flat indexed grids in the xz plane, neighbouring cells share their vertices
+namespace GridGenerator {
+	struct GridInfo {
+		uint32_t cellsX = 1;
+		uint32_t cellsZ = 1;
+		float cellSize = 1.f;
+		glm::vec2 origin{ 0.f }; //xz position of the first vertex
+		//cells in [holeMin, holeMax) are left out together with the vertices only they use
+		glm::uvec2 holeMin{ 0 };
+		glm::uvec2 holeMax{ 0 };
+		bool parallel = true; //rows are generated on the worker pool
+	};
+
+	//square grid of cellsPerSide cells centered on the origin, cells are 2^level * baseCellSize wide
+	//every level above 0 leaves out its inner half, which is exactly the extent of the level below
+	GridInfo ring(uint32_t level, uint32_t cellsPerSide, float baseCellSize);
+
+	//fills geometry with exactly sized vertex and index arrays, uvs run from 0 to 1 over the whole grid
+	void generate(const GridInfo& info, Model::Geometry& geometry);
+}
@@ -0,0 +1,159 @@
+#include "heightfield.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HEIGHTFIELD_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "spdlog/spdlog.h"
+#include "stb_image.h"
+
+Heightfield::Heightfield(uint32_t width, uint32_t height, std::vector<uint16_t> samples)
+		: width{ width }, height{ height }, owned{ std::move(samples) } {
+	if (owned.size() != static_cast<size_t>(width) * height) {
+		spdlog::critical("Heightfield of {}x{} got {} samples", width, height, owned.size());
+		throw std::runtime_error("Heightfield");
+	}
+	this->samples = owned.data();
+}
+
+Heightfield Heightfield::load(const std::string& filepath) {
+	if (std::filesystem::path(filepath).extension() == ".r16") {
+		return loadRaw(filepath);
+	}
+
+	int width, height, channels;
+	stbi_us* pixels = stbi_load_16(filepath.c_str(), &width, &height, &channels, 1);
+	if (!pixels) {
+		spdlog::critical("Failed to load heightfield {}", filepath);
+		throw std::runtime_error("load");
+	}
+	std::vector<uint16_t> samples(pixels, pixels + static_cast<size_t>(width) * height);
+	stbi_image_free(pixels);
+	return Heightfield(static_cast<uint32_t>(width), static_cast<uint32_t>(height), std::move(samples));
+}
+
+Heightfield Heightfield::loadRaw(const std::string& filepath, uint32_t width, uint32_t height) {
+	auto mapped = std::make_shared<MappedFile>(filepath);
+	if (!mapped->isOpen()) {
+		spdlog::critical("Failed to map heightfield {}", filepath);
+		throw std::runtime_error("loadRaw");
+	}
+
+	size_t count = mapped->size() / sizeof(uint16_t);
+	if (width == 0) {
+		width = static_cast<uint32_t>(std::llround(std::sqrt(static_cast<double>(count))));
+		height = width;
+	}
+	if (static_cast<size_t>(width) * height != count) {
+		spdlog::critical("Heightfield {} holds {} samples, not {}x{}", filepath, count, width, height);
+		throw std::runtime_error("loadRaw");
+	}
+
+	//pages are only read in when a region or query touches them
+	Heightfield field;
+	field.width = width;
+	field.height = height;
+	field.mapped = std::move(mapped);
+	field.samples = static_cast<const uint16_t*>(field.mapped->data());
+	return field;
+}
+
+uint16_t Heightfield::at(int32_t x, int32_t z) const {
+	x = std::clamp(x, 0, static_cast<int32_t>(width) - 1);
+	z = std::clamp(z, 0, static_cast<int32_t>(height) - 1);
+	return samples[static_cast<size_t>(z) * width + x];
+}
+
+float Heightfield::sampleBilinear(float x, float z) const {
+	x = std::clamp(x, 0.f, static_cast<float>(width - 1));
+	z = std::clamp(z, 0.f, static_cast<float>(height - 1));
+	int32_t x0 = static_cast<int32_t>(x);
+	int32_t z0 = static_cast<int32_t>(z);
+	float fx = x - x0;
+	float fz = z - z0;
+	float top = sample(x0, z0) + (sample(x0 + 1, z0) - sample(x0, z0)) * fx;
+	float bottom = sample(x0, z0 + 1) + (sample(x0 + 1, z0 + 1) - sample(x0, z0 + 1)) * fx;
+	return top + (bottom - top) * fz;
+}
+
+void Heightfield::sampleBilinear(const glm::vec2* texels, float* heights, size_t count) const {
+	size_t i = 0;
+#ifdef HEIGHTFIELD_SSE2
+	if (width >= 2 && height >= 2) {
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 maxX = _mm_set1_ps(static_cast<float>(width - 1));
+		const __m128 maxZ = _mm_set1_ps(static_cast<float>(height - 1));
+		const __m128i lastX = _mm_set1_epi32(static_cast<int32_t>(width) - 2);
+		const __m128i lastZ = _mm_set1_epi32(static_cast<int32_t>(height) - 2);
+		const __m128 normalize = _mm_set1_ps(1.f / 65535.f);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 first = _mm_loadu_ps(&texels[i].x);
+			__m128 second = _mm_loadu_ps(&texels[i + 2].x);
+			__m128 x = _mm_min_ps(_mm_max_ps(_mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0)), zero), maxX);
+			__m128 z = _mm_min_ps(_mm_max_ps(_mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1)), zero), maxZ);
+
+			//coordinates are clamped so truncation floors, the last texel steps back one so x0 + 1 stays inside
+			__m128i x0 = _mm_cvttps_epi32(x);
+			__m128i z0 = _mm_cvttps_epi32(z);
+			x0 = _mm_add_epi32(x0, _mm_cmpgt_epi32(x0, lastX));
+			z0 = _mm_add_epi32(z0, _mm_cmpgt_epi32(z0, lastZ));
+			__m128 fx = _mm_sub_ps(x, _mm_cvtepi32_ps(x0));
+			__m128 fz = _mm_sub_ps(z, _mm_cvtepi32_ps(z0));
+
+			//sse2 has no gather, the corners are fetched one lane at a time
+			alignas(16) int32_t xs[4], zs[4];
+			alignas(16) float c00[4], c10[4], c01[4], c11[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(xs), x0);
+			_mm_store_si128(reinterpret_cast<__m128i*>(zs), z0);
+			for (uint32_t lane = 0; lane < 4; lane++) {
+				const uint16_t* corner = samples + static_cast<size_t>(zs[lane]) * width + xs[lane];
+				c00[lane] = corner[0];
+				c10[lane] = corner[1];
+				c01[lane] = corner[width];
+				c11[lane] = corner[width + 1];
+			}
+
+			__m128 top = _mm_load_ps(c00);
+			__m128 bottom = _mm_load_ps(c01);
+			top = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(c10), top), fx));
+			bottom = _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(c11), bottom), fx));
+			__m128 result = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fz));
+			_mm_storeu_ps(heights + i, _mm_mul_ps(result, normalize));
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		heights[i] = sampleBilinear(texels[i].x, texels[i].y);
+	}
+}
+
+glm::vec3 Heightfield::normal(int32_t x, int32_t z, float texelSize, float heightScale) const {
+	float tl = sample(x - 1, z - 1), t = sample(x, z - 1), tr = sample(x + 1, z - 1);
+	float l = sample(x - 1, z), r = sample(x + 1, z);
+	float bl = sample(x - 1, z + 1), b = sample(x, z + 1), br = sample(x + 1, z + 1);
+	float gx = (tr + 2.f * r + br) - (tl + 2.f * l + bl);
+	float gz = (bl + 2.f * b + br) - (tl + 2.f * t + tr);
+	float scale = heightScale / (8.f * texelSize);
+	return glm::normalize(glm::vec3(-gx * scale, 1.f, -gz * scale));
+}
+
+Heightfield Heightfield::region(int32_t x, int32_t z, uint32_t width, uint32_t height) const {
+	std::vector<uint16_t> samples(static_cast<size_t>(width) * height);
+	for (uint32_t row = 0; row < height; row++) {
+		int32_t sourceRow = std::clamp(z + static_cast<int32_t>(row), 0, static_cast<int32_t>(this->height) - 1);
+		const uint16_t* source = this->samples + static_cast<size_t>(sourceRow) * this->width;
+		uint16_t* destination = samples.data() + static_cast<size_t>(row) * width;
+		for (uint32_t column = 0; column < width; column++) {
+			int32_t sourceColumn = std::clamp(x + static_cast<int32_t>(column), 0, static_cast<int32_t>(this->width) - 1);
+			destination[column] = source[sourceColumn];
+		}
+	}
+	return Heightfield(width, height, std::move(samples));
+}
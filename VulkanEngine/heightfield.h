@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "glm/glm.hpp"
+
+#include "mappedFile.h"
+
+//16-bit single channel heights kept on the cpu for height queries, collision and normals
+//samples are either owned or point straight into a memory mapped .r16 file
+class Heightfield {
+public:
+	Heightfield() = default;
+	Heightfield(uint32_t width, uint32_t height, std::vector<uint16_t> samples);
+
+	//samples may point into owned, so only moves are allowed
+	Heightfield(const Heightfield&) = delete;
+	Heightfield& operator=(const Heightfield&) = delete;
+	Heightfield(Heightfield&&) = default;
+	Heightfield& operator=(Heightfield&&) = default;
+
+	//.r16 files are mapped, anything else goes through stbi_load_16 which widens 8-bit images
+	static Heightfield load(const std::string& filepath);
+	//raw little endian samples, a zero width assumes a square file
+	static Heightfield loadRaw(const std::string& filepath, uint32_t width = 0, uint32_t height = 0);
+
+	bool empty() const { return samples == nullptr; }
+	uint32_t getWidth() const { return width; }
+	uint32_t getHeight() const { return height; }
+	const uint16_t* data() const { return samples; }
+
+	//coordinates outside the field clamp to the border
+	uint16_t at(int32_t x, int32_t z) const;
+	float sample(int32_t x, int32_t z) const { return at(x, z) / 65535.f; }
+	//bilinear between texel centers, in texel coordinates
+	float sampleBilinear(float x, float z) const;
+	//the same for count texel positions, four at a time with sse2 where available
+	void sampleBilinear(const glm::vec2* texels, float* heights, size_t count) const;
+
+	//sobel normal of a texel with y up, texelSize is the world size of a texel and heightScale the world height of 1.0
+	glm::vec3 normal(int32_t x, int32_t z, float texelSize, float heightScale) const;
+
+	//copy of a rectangle, texels outside clamp to the border
+	Heightfield region(int32_t x, int32_t z, uint32_t width, uint32_t height) const;
+
+private:
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint16_t> owned;
+	std::shared_ptr<MappedFile> mapped;
+	const uint16_t* samples = nullptr;
+};
@@ -4,12 +4,74 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
 #include "engine.h"
+#include "model.h"
+#include "settings.h"
+
+//times a cold obj import (no mesh cache) of the bundled models
+static void benchmarkImport() {
+	const std::vector<std::string> models = { "models/backpack/backpack.obj", "models/rock/rock.obj" };
+	const int runs = 5;
+	for (auto& filepath : models) {
+		float best = 0.f, total = 0.f;
+		size_t vertexCount = 0, indexCount = 0;
+		for (int i = 0; i < runs; i++) {
+			auto start = std::chrono::high_resolution_clock::now();
+			Model::Geometry geometry{};
+			try {
+				geometry.importObj(filepath);
+			}
+			catch (const std::exception& e) {
+				spdlog::warn("Skipping {}: {}", filepath, e.what());
+				break;
+			}
+			float elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+			best = i == 0 ? elapsed : std::min(best, elapsed);
+			total += elapsed;
+			vertexCount = geometry.vertexCount();
+			indexCount = geometry.indexCount();
+		}
+		if (vertexCount == 0) {
+			continue;
+		}
+		spdlog::info("{}: best {:.1f}ms, mean {:.1f}ms over {} runs ({} vertices, {} indices)",
+			filepath, best, total / runs, runs, vertexCount, indexCount);
+	}
+}
 
-int main() {
+int main(int argc, char* argv[]) {
 	//set global levels to debug
 	spdlog::set_level(spdlog::level::debug);
 
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			Settings::headless = true;
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			Settings::maxFrames = std::stoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+			Settings::width = std::stoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+			Settings::height = std::stoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--bench-import") == 0) {
+			benchmarkImport();
+			return EXIT_SUCCESS;
+		}
+		else {
+			spdlog::warn("Unknown argument {}", argv[i]);
+		}
+	}
+
 	Engine engine{};
 	try {
 		engine.run();
@@ -0,0 +1,76 @@
+#include "mappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& filepath) {
+	HANDLE handle = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	file = handle;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0) {
+		return;
+	}
+
+	mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		return;
+	}
+
+	data_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data_) {
+		size_ = static_cast<size_t>(fileSize.QuadPart);
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (data_) {
+		UnmapViewOfFile(data_);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	if (file) {
+		CloseHandle(file);
+	}
+}
+#else
+MappedFile::MappedFile(const std::string& filepath) {
+	file = open(filepath.c_str(), O_RDONLY);
+	if (file < 0) {
+		return;
+	}
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		return;
+	}
+
+	void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	if (mapped != MAP_FAILED) {
+		data_ = mapped;
+		size_ = static_cast<size_t>(info.st_size);
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (data_) {
+		munmap(const_cast<void*>(data_), size_);
+	}
+	if (file >= 0) {
+		close(file);
+	}
+}
+#endif
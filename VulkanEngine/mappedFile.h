@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//read only memory mapping of a whole file
+class MappedFile {
+public:
+	MappedFile(const std::string& filepath);
+	~MappedFile();
+
+	//delete copy constructors
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool isOpen() const { return data_ != nullptr; }
+	const void* data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	const void* data_ = nullptr;
+	size_t size_ = 0;
+
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#else
+	int file = -1;
+#endif
+};
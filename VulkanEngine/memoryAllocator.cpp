@@ -0,0 +1,233 @@
+#include "memoryAllocator.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include "spdlog/spdlog.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+MemoryAllocator::MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice) : device{ device } {
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	bufferImageGranularity = properties.limits.bufferImageGranularity;
+}
+
+MemoryAllocator::~MemoryAllocator() {
+	for (auto& pool : pools) {
+		for (auto& block : pool.second) {
+			if (block->allocationCount > 0) {
+				spdlog::warn("Freeing memory block with {} live allocations", block->allocationCount);
+			}
+			if (block->mapped) {
+				vkUnmapMemory(device, block->memory);
+			}
+			vkFreeMemory(device, block->memory, nullptr);
+		}
+	}
+	pools.clear();
+}
+
+Allocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, bool linear) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	//with a granularity of 1 buffers and images can safely sit side by side
+	if (bufferImageGranularity <= 1) {
+		linear = true;
+	}
+
+	Allocation allocation{};
+	VkDeviceSize blockSize = preferredBlockSize(memoryTypeIndex);
+
+	//large resources get their own block rather than wasting most of a shared one
+	if (requirements.size > blockSize / 2) {
+		MemoryBlock* block = createBlock(memoryTypeIndex, linear, requirements.size, true);
+		allocateFromBlock(*block, requirements.size, requirements.alignment, allocation);
+		return allocation;
+	}
+
+	auto& blocks = pools[{ memoryTypeIndex, linear }];
+	for (auto& block : blocks) {
+		if (!block->dedicated && allocateFromBlock(*block, requirements.size, requirements.alignment, allocation)) {
+			return allocation;
+		}
+	}
+
+	MemoryBlock* block = createBlock(memoryTypeIndex, linear, blockSize, false);
+	if (!allocateFromBlock(*block, requirements.size, requirements.alignment, allocation)) {
+		spdlog::critical("Failed to suballocate {} bytes from a fresh block", requirements.size);
+		throw std::runtime_error("allocate");
+	}
+	return allocation;
+}
+
+void MemoryAllocator::free(Allocation& allocation) {
+	if (allocation.block == nullptr) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+
+	MemoryBlock* block = allocation.block;
+	freeRange(*block, allocation.offset, allocation.size);
+	block->used -= allocation.size;
+	block->allocationCount--;
+
+	//keep one empty shared block per pool around so load/unload cycles don't thrash vkAllocateMemory
+	if (block->allocationCount == 0) {
+		auto& blocks = pools[{ block->memoryTypeIndex, block->linear }];
+		bool otherEmpty = std::any_of(blocks.begin(), blocks.end(), [&](const std::unique_ptr<MemoryBlock>& other) {
+			return other.get() != block && !other->dedicated && other->allocationCount == 0;
+		});
+		if (block->dedicated || otherEmpty) {
+			destroyBlock(block);
+		}
+	}
+
+	allocation = Allocation{};
+}
+
+AllocatorStats MemoryAllocator::getStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	AllocatorStats stats{};
+	VkDeviceSize totalFree = 0;
+	for (auto& pool : pools) {
+		for (auto& block : pool.second) {
+			stats.blockCount++;
+			if (block->dedicated) {
+				stats.dedicatedBlockCount++;
+			}
+			stats.allocationCount += block->allocationCount;
+			stats.bytesReserved += block->size;
+			stats.bytesUsed += block->used;
+			for (auto& range : block->freeRanges) {
+				totalFree += range.second;
+				stats.largestFreeRange = std::max(stats.largestFreeRange, range.second);
+			}
+		}
+	}
+	if (totalFree > 0) {
+		stats.fragmentation = 1.f - static_cast<float>(stats.largestFreeRange) / static_cast<float>(totalFree);
+	}
+	return stats;
+}
+
+VkDeviceSize MemoryAllocator::preferredBlockSize(uint32_t memoryTypeIndex) {
+	uint32_t heapIndex = memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[heapIndex].size;
+
+	//small heaps (e.g. 256MB host visible vram) would be exhausted by a few default blocks
+	if (heapSize <= 1024ull * 1024 * 1024) {
+		return alignUp(heapSize / 8, 1024);
+	}
+	return defaultBlockSize;
+}
+
+MemoryBlock* MemoryAllocator::createBlock(uint32_t memoryTypeIndex, bool linear, VkDeviceSize size, bool dedicated) {
+	auto block = std::make_unique<MemoryBlock>();
+	block->size = size;
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->linear = linear;
+	block->dedicated = dedicated;
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+		spdlog::critical("Failed to allocate memory block of {} bytes", size);
+		throw std::runtime_error("createBlock");
+	}
+
+	//host visible blocks stay mapped for their whole lifetime, a VkDeviceMemory can only be mapped once
+	if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS) {
+			spdlog::critical("Failed to map memory block");
+			throw std::runtime_error("createBlock");
+		}
+	}
+
+	block->freeRanges[0] = size;
+
+	MemoryBlock* result = block.get();
+	pools[{ memoryTypeIndex, linear }].push_back(std::move(block));
+	return result;
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock* block) {
+	auto& blocks = pools[{ block->memoryTypeIndex, block->linear }];
+	auto it = std::find_if(blocks.begin(), blocks.end(), [&](const std::unique_ptr<MemoryBlock>& other) { return other.get() == block; });
+	if (it == blocks.end()) {
+		return;
+	}
+
+	if (block->mapped) {
+		vkUnmapMemory(device, block->memory);
+	}
+	vkFreeMemory(device, block->memory, nullptr);
+	blocks.erase(it);
+}
+
+bool MemoryAllocator::allocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation) {
+	//best fit keeps large ranges intact for large resources
+	auto best = block.freeRanges.end();
+	VkDeviceSize bestWaste = ~0ull;
+	for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); it++) {
+		VkDeviceSize aligned = alignUp(it->first, alignment);
+		if (aligned + size <= it->first + it->second && it->second - size < bestWaste) {
+			best = it;
+			bestWaste = it->second - size;
+		}
+	}
+	if (best == block.freeRanges.end()) {
+		return false;
+	}
+
+	VkDeviceSize rangeOffset = best->first;
+	VkDeviceSize rangeEnd = best->first + best->second;
+	VkDeviceSize aligned = alignUp(rangeOffset, alignment);
+	block.freeRanges.erase(best);
+
+	//alignment padding and the tail go back on the free list
+	if (aligned > rangeOffset) {
+		block.freeRanges[rangeOffset] = aligned - rangeOffset;
+	}
+	if (aligned + size < rangeEnd) {
+		block.freeRanges[aligned + size] = rangeEnd - (aligned + size);
+	}
+
+	block.used += size;
+	block.allocationCount++;
+
+	allocation.memory = block.memory;
+	allocation.offset = aligned;
+	allocation.size = size;
+	allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + aligned : nullptr;
+	allocation.block = &block;
+	return true;
+}
+
+void MemoryAllocator::freeRange(MemoryBlock& block, VkDeviceSize offset, VkDeviceSize size) {
+	auto next = block.freeRanges.lower_bound(offset);
+
+	if (next != block.freeRanges.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			block.freeRanges.erase(prev);
+		}
+	}
+	if (next != block.freeRanges.end() && offset + size == next->first) {
+		size += next->second;
+		block.freeRanges.erase(next);
+	}
+
+	block.freeRanges[offset] = size;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+//a large VkDeviceMemory carved into suballocations
+struct MemoryBlock {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	VkDeviceSize used = 0;
+	void* mapped = nullptr;
+	uint32_t memoryTypeIndex = 0;
+	bool linear = true;
+	bool dedicated = false;
+	uint32_t allocationCount = 0;
+	std::map<VkDeviceSize, VkDeviceSize> freeRanges; //offset -> size, kept coalesced
+};
+
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr; //points at offset when the memory is host visible
+	MemoryBlock* block = nullptr;
+};
+
+struct AllocatorStats {
+	uint32_t blockCount = 0;
+	uint32_t dedicatedBlockCount = 0;
+	uint32_t allocationCount = 0;
+	VkDeviceSize bytesReserved = 0;
+	VkDeviceSize bytesUsed = 0;
+	VkDeviceSize largestFreeRange = 0;
+	float fragmentation = 0.f; //1 - largest free range / total free, 0 when free space is contiguous
+};
+
+class MemoryAllocator {
+public:
+	MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice);
+	~MemoryAllocator();
+
+	//delete copy constructors
+	MemoryAllocator(const MemoryAllocator&) = delete;
+	MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+	//linear is true for buffers and linear images, false for optimal tiled images
+	Allocation allocate(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, bool linear);
+	void free(Allocation& allocation);
+
+	AllocatorStats getStats();
+
+private:
+	static constexpr VkDeviceSize defaultBlockSize = 64ull * 1024 * 1024;
+
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDeviceSize bufferImageGranularity;
+
+	//linear and optimal resources never share a block so bufferImageGranularity can't be violated
+	std::map<std::pair<uint32_t, bool>, std::vector<std::unique_ptr<MemoryBlock>>> pools;
+	std::mutex mutex;
+
+	VkDeviceSize preferredBlockSize(uint32_t memoryTypeIndex);
+	MemoryBlock* createBlock(uint32_t memoryTypeIndex, bool linear, VkDeviceSize size, bool dedicated);
+	void destroyBlock(MemoryBlock* block);
+	bool allocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation);
+	void freeRange(MemoryBlock& block, VkDeviceSize offset, VkDeviceSize size);
+};
@@ -0,0 +1,285 @@
+#include "meshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace MeshOptimizer {
+	VertexCacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+		VertexCacheStatistics statistics{};
+		if (indices.empty() || vertexCount == 0) {
+			return statistics;
+		}
+
+		//timestamps make the fifo lookup O(1): a vertex is cached if it was inserted less than cacheSize misses ago
+		std::vector<uint32_t> insertedAt(vertexCount, 0);
+		uint32_t misses = 0;
+		for (uint32_t index : indices) {
+			if (insertedAt[index] == 0 || misses + 1 - insertedAt[index] > cacheSize) {
+				misses++;
+				insertedAt[index] = misses;
+			}
+		}
+
+		statistics.acmr = static_cast<float>(misses) / (indices.size() / 3);
+		statistics.atvr = static_cast<float>(misses) / vertexCount;
+		return statistics;
+	}
+
+	static constexpr int forsythCacheSize = 32;
+
+	static float vertexScore(int cachePosition, uint32_t activeTriangles) {
+		if (activeTriangles == 0) {
+			return -1.f;
+		}
+
+		float score = 0.f;
+		if (cachePosition >= 0) {
+			//the last triangle's vertices get a fixed score so the next triangle doesn't just reuse its edge
+			if (cachePosition < 3) {
+				score = 0.75f;
+			}
+			else {
+				float scale = 1.f / (forsythCacheSize - 3);
+				score = std::pow(1.f - (cachePosition - 3) * scale, 1.5f);
+			}
+		}
+		//favour vertices with few triangles left so they get finished off
+		score += 2.f / std::sqrt(static_cast<float>(activeTriangles));
+		return score;
+	}
+
+	void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		//triangle adjacency per vertex, the active part of each list shrinks as triangles are emitted
+		std::vector<uint32_t> activeTriangles(vertexCount, 0);
+		for (uint32_t index : indices) {
+			activeTriangles[index]++;
+		}
+		std::vector<uint32_t> offsets(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++) {
+			offsets[v + 1] = offsets[v] + activeTriangles[v];
+		}
+		std::vector<uint32_t> adjacency(indices.size());
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++) {
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> scores(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			scores[v] = vertexScore(-1, activeTriangles[v]);
+		}
+
+		std::vector<float> triangleScores(triangleCount);
+		std::vector<bool> emitted(triangleCount, false);
+		int bestTriangle = 0;
+		for (size_t t = 0; t < triangleCount; t++) {
+			triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+			if (triangleScores[t] > triangleScores[bestTriangle]) {
+				bestTriangle = static_cast<int>(t);
+			}
+		}
+
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+		uint32_t cache[forsythCacheSize + 3];
+		uint32_t newCache[forsythCacheSize + 3];
+		size_t cacheCount = 0;
+		size_t scanCursor = 0;
+
+		while (output.size() < indices.size()) {
+			//nothing adjacent to the cache is left, continue with the next unemitted triangle
+			if (bestTriangle < 0) {
+				while (emitted[scanCursor]) {
+					scanCursor++;
+				}
+				bestTriangle = static_cast<int>(scanCursor);
+			}
+
+			const uint32_t* triangle = &indices[bestTriangle * 3];
+			emitted[bestTriangle] = true;
+			output.insert(output.end(), triangle, triangle + 3);
+
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = triangle[k];
+				uint32_t* list = &adjacency[offsets[v]];
+				for (uint32_t i = 0; i < activeTriangles[v]; i++) {
+					if (list[i] == static_cast<uint32_t>(bestTriangle)) {
+						std::swap(list[i], list[activeTriangles[v] - 1]);
+						break;
+					}
+				}
+				activeTriangles[v]--;
+			}
+
+			//emitted vertices move to the front, everything else shifts back
+			size_t newCount = 0;
+			for (int k = 0; k < 3; k++) {
+				newCache[newCount++] = triangle[k];
+			}
+			for (size_t i = 0; i < cacheCount; i++) {
+				uint32_t v = cache[i];
+				if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+					newCache[newCount++] = v;
+				}
+			}
+
+			for (size_t i = 0; i < newCount; i++) {
+				uint32_t v = newCache[i];
+				cachePosition[v] = i < forsythCacheSize ? static_cast<int>(i) : -1;
+				scores[v] = vertexScore(cachePosition[v], activeTriangles[v]);
+			}
+
+			bestTriangle = -1;
+			float bestScore = -1.f;
+			for (size_t i = 0; i < newCount; i++) {
+				uint32_t v = newCache[i];
+				for (uint32_t j = 0; j < activeTriangles[v]; j++) {
+					uint32_t t = adjacency[offsets[v] + j];
+					triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+					if (triangleScores[t] > bestScore) {
+						bestScore = triangleScores[t];
+						bestTriangle = static_cast<int>(t);
+					}
+				}
+			}
+
+			cacheCount = std::min(newCount, static_cast<size_t>(forsythCacheSize));
+			std::copy(newCache, newCache + cacheCount, cache);
+		}
+
+		indices.swap(output);
+	}
+
+	bool optimizeOverdraw(std::vector<uint32_t>& indices,
+			const float* positions,
+			size_t vertexCount,
+			size_t positionStride,
+			float threshold) {
+		const size_t minClusterSize = 64;
+		const uint32_t cacheSize = 16;
+		size_t triangleCount = indices.size() / 3;
+		if (triangleCount < minClusterSize * 2) {
+			return false;
+		}
+
+		auto position = [&](uint32_t index) {
+			return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + index * positionStride);
+		};
+
+		//clusters break where the cache simulation restarts (all three vertices miss), so sorting them keeps most hits
+		std::vector<size_t> clusterStarts = { 0 };
+		std::vector<uint32_t> insertedAt(vertexCount, 0);
+		uint32_t misses = 0;
+		for (size_t t = 0; t < triangleCount; t++) {
+			int triangleMisses = 0;
+			for (int k = 0; k < 3; k++) {
+				uint32_t index = indices[t * 3 + k];
+				if (insertedAt[index] == 0 || misses + 1 - insertedAt[index] > cacheSize) {
+					misses++;
+					insertedAt[index] = misses;
+					triangleMisses++;
+				}
+			}
+			if (triangleMisses == 3 && t - clusterStarts.back() >= minClusterSize) {
+				clusterStarts.push_back(t);
+			}
+		}
+		if (clusterStarts.size() < 2) {
+			return false;
+		}
+		clusterStarts.push_back(triangleCount);
+
+		//area weighted centroids and normals, clusters facing away from the mesh center draw first
+		struct Cluster {
+			size_t begin;
+			size_t end;
+			float sortKey;
+		};
+		std::vector<Cluster> clusters;
+		float meshCentroid[3] = { 0.f, 0.f, 0.f };
+		float meshArea = 0.f;
+		std::vector<float> clusterData((clusterStarts.size() - 1) * 7, 0.f); //centroid xyz, normal xyz, area
+		for (size_t c = 0; c + 1 < clusterStarts.size(); c++) {
+			float* data = &clusterData[c * 7];
+			for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+				const float* p0 = position(indices[t * 3]);
+				const float* p1 = position(indices[t * 3 + 1]);
+				const float* p2 = position(indices[t * 3 + 2]);
+				float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+				float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+				float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+				float area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+				for (int k = 0; k < 3; k++) {
+					data[k] += (p0[k] + p1[k] + p2[k]) / 3.f * area;
+					data[3 + k] += normal[k];
+				}
+				data[6] += area;
+			}
+			for (int k = 0; k < 3; k++) {
+				meshCentroid[k] += data[k];
+			}
+			meshArea += data[6];
+		}
+		if (meshArea <= 0.f) {
+			return false;
+		}
+		for (int k = 0; k < 3; k++) {
+			meshCentroid[k] /= meshArea;
+		}
+
+		for (size_t c = 0; c + 1 < clusterStarts.size(); c++) {
+			float* data = &clusterData[c * 7];
+			float sortKey = 0.f;
+			float normalLength = std::sqrt(data[3] * data[3] + data[4] * data[4] + data[5] * data[5]);
+			if (data[6] > 0.f && normalLength > 0.f) {
+				for (int k = 0; k < 3; k++) {
+					sortKey += (data[k] / data[6] - meshCentroid[k]) * data[3 + k] / normalLength;
+				}
+			}
+			clusters.push_back({ clusterStarts[c], clusterStarts[c + 1], sortKey });
+		}
+
+		std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+		for (auto& cluster : clusters) {
+			output.insert(output.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+		}
+
+		float before = analyzeVertexCache(indices, vertexCount).acmr;
+		float after = analyzeVertexCache(output, vertexCount).acmr;
+		if (after > before * threshold) {
+			return false;
+		}
+		indices.swap(output);
+		return true;
+	}
+
+	size_t optimizeVertexFetch(void* vertices, std::vector<uint32_t>& indices, size_t vertexCount, size_t vertexSize) {
+		std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+		uint32_t next = 0;
+		for (uint32_t& index : indices) {
+			if (remap[index] == UINT32_MAX) {
+				remap[index] = next++;
+			}
+			index = remap[index];
+		}
+
+		char* data = static_cast<char*>(vertices);
+		std::vector<char> source(data, data + vertexCount * vertexSize);
+		for (size_t v = 0; v < vertexCount; v++) {
+			if (remap[v] != UINT32_MAX) {
+				memcpy(data + remap[v] * vertexSize, source.data() + v * vertexSize, vertexSize);
+			}
+		}
+		return next;
+	}
+}
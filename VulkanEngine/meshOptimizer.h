@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//import time index/vertex reordering for triangle lists
+namespace MeshOptimizer {
+	struct VertexCacheStatistics {
+		float acmr = 0.f; //average cache miss ratio, transformed vertices per triangle (0.5 - 3)
+		float atvr = 0.f; //average transformed vertex ratio, transformed vertices per vertex (1 is ideal)
+	};
+
+	//simulates a fifo post transform cache, 16 entries is a reasonable stand in for current hardware
+	VertexCacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = 16);
+
+	//reorders triangles for post transform cache locality (Forsyth, linear speed vertex cache optimisation)
+	void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+	//reorders clusters of the cache optimized order so outward facing ones draw first (Sander et al.)
+	//keeps the old order and returns false if the ACMR would grow by more than threshold
+	bool optimizeOverdraw(std::vector<uint32_t>& indices,
+		const float* positions,
+		size_t vertexCount,
+		size_t positionStride,
+		float threshold = 1.05f);
+
+	//renumbers vertices in order of first use so fetches walk memory linearly, unused vertices are dropped
+	//returns the new vertex count
+	size_t optimizeVertexFetch(void* vertices, std::vector<uint32_t>& indices, size_t vertexCount, size_t vertexSize);
+}
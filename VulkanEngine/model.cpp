@@ -1,102 +1,169 @@
 #include "model.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <cstring>
-#include <unordered_map>
+#include <filesystem>
+#include <fstream>
 
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
 #include "spdlog/spdlog.h"
-#include "stb_image.h"
 
 
 #include "utils.h"
-#include "assetManager.h"
+#include "gridGenerator.h"
+#include "meshOptimizer.h"
+#include "threadPool.h"
+#include "uploadManager.h"
+
+Model::Model(Device& device, const Model::Geometry& geometry, std::shared_ptr<Texture> texture, VertexFormat format) : device{ device }, texture{ texture }, format{ format } {
+	if (format == VertexFormat::Packed) {
+		createPackedVertexBuffers(geometry.vertexData(), geometry.vertexCount());
+	}
+	else {
+		createVertexBuffers(geometry.vertexData(), geometry.vertexCount());
+	}
+	createIndexBuffers(geometry.indexData(), geometry.indexCount());
+	computeBounds(geometry.vertexData(), geometry.vertexCount());
+}
+Model::~Model() {}
 
-template <>
-struct std::hash<Model::Vertex> {
-	size_t operator()(Model::Vertex const& vertex) const {
-		size_t seed = 0;
-		Utils::hashCombine(seed, vertex.position, vertex.color, vertex.normal, vertex.texCoord);
-		return seed;
+void Model::computeBounds(const Vertex* vertices, uint32_t vertexCount) {
+	if (vertexCount == 0) {
+		return;
 	}
-};
+	//the sphere is centered on the box, not minimal but tight enough for culling
+	glm::vec3 min = vertices[0].position;
+	glm::vec3 max = vertices[0].position;
+	for (uint32_t i = 1; i < vertexCount; i++) {
+		min = glm::min(min, vertices[i].position);
+		max = glm::max(max, vertices[i].position);
+	}
+	boundsMin = min;
+	boundsMax = max;
+
+	glm::vec3 center = (min + max) * 0.5f;
+	float radiusSquared = 0.f;
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		glm::vec3 offset = vertices[i].position - center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	boundingSphere = glm::vec4(center, std::sqrt(radiusSquared));
+}
 
-Model::Model(Device& device, const Model::Geometry& geometry, std::shared_ptr<Texture> texture) : device{ device }, texture{ texture } {
-	createVertexBuffers(geometry.vertices);
-	createIndexBuffers(geometry.indices);
+void Model::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance) {
+	if (hasIndexBuffer) {
+		vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, firstInstance);
+	}
+	else {
+		vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, firstInstance);
+	}
 }
-Model::~Model() {}
 
-void Model::draw(VkCommandBuffer commandBuffer) {
+void Model::drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset) {
 	if (hasIndexBuffer) {
-		vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+		vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, 1, sizeof(VkDrawIndexedIndirectCommand));
 	}
 	else {
-		vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+		vkCmdDrawIndirect(commandBuffer, buffer, offset, 1, sizeof(VkDrawIndirectCommand));
 	}
 }
 
+void Model::writeIndirectCommand(uint32_t command[5]) const {
+	command[0] = hasIndexBuffer ? indexCount : static_cast<uint32_t>(vertexCount);
+	command[1] = 0;
+	command[2] = 0;
+	command[3] = 0;
+	command[4] = 0;
+}
+
 void Model::bind(VkCommandBuffer commandBuffer) {
-	VkBuffer buffers[] = { vertexBuffer->getBuffer() };
+	VkBuffer buffers[] = { positionBuffer->getBuffer(), attributeBuffer->getBuffer() };
+	VkDeviceSize offsets[] = { 0, 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, buffers, offsets);
+	if (hasIndexBuffer) {
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, indexType);
+	}
+}
+
+void Model::bindPositions(VkCommandBuffer commandBuffer) {
+	VkBuffer buffers[] = { positionBuffer->getBuffer() };
 	VkDeviceSize offsets[] = { 0 };
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
 	if (hasIndexBuffer) {
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, indexType);
 	}
 }
 
-std::unique_ptr<Model> Model::createModelFromFile(Device& device, const std::string& filepath, std::shared_ptr<Texture> texture) {
+std::unique_ptr<Model> Model::createModelFromFile(Device& device, const std::string& filepath, std::shared_ptr<Texture> texture, VertexFormat format) {
 	Geometry geometry{};
 	geometry.loadModel(filepath);
-	return std::make_unique<Model>(device, geometry, texture);
+	return std::make_unique<Model>(device, geometry, texture, format);
 }
 
-void Model::createVertexBuffers(const std::vector<Vertex>& vertices) {
-	vertexCount = static_cast<uint32_t>(vertices.size());
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-	uint32_t vertexSize = sizeof(vertices[0]);
-
-	Buffer stagingBuffer {
-		device, vertexSize, static_cast<uint32_t>(vertexCount),
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	};
-	stagingBuffer.map();
-	stagingBuffer.writeToBuffer((void*)vertices.data());
-
-
-	vertexBuffer = std::make_unique<Buffer>(
-		device, vertexSize, vertexCount,
+std::unique_ptr<Buffer> Model::createVertexStream(const void* data, uint32_t stride, uint32_t vertexCount) {
+	auto buffer = std::make_unique<Buffer>(
+		device, stride, vertexCount,
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 	);
+	device.uploader().uploadBuffer(data, static_cast<VkDeviceSize>(stride) * vertexCount, buffer->getBuffer());
+	return buffer;
+}
 
-	device.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
+void Model::createVertexBuffers(const Vertex* vertices, uint32_t vertexCount) {
+	this->vertexCount = vertexCount;
+
+	//the cpu side stays interleaved, split it into the position and attribute streams here
+	std::vector<glm::vec3> positions(vertexCount);
+	std::vector<Vertex::Attributes> attributes(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		positions[i] = vertices[i].position;
+		attributes[i] = { vertices[i].color, vertices[i].normal, vertices[i].texCoord };
+	}
+
+	positionBuffer = createVertexStream(positions.data(), sizeof(glm::vec3), vertexCount);
+	attributeBuffer = createVertexStream(attributes.data(), sizeof(Vertex::Attributes), vertexCount);
+}
+
+void Model::createPackedVertexBuffers(const Vertex* vertices, uint32_t vertexCount) {
+	this->vertexCount = vertexCount;
+	std::vector<PackedVertex::Position> positions;
+	std::vector<PackedVertex::Attributes> attributes;
+	packVertices(vertices, vertexCount, positions, attributes, dequantization);
+
+	positionBuffer = createVertexStream(positions.data(), sizeof(PackedVertex::Position), vertexCount);
+	attributeBuffer = createVertexStream(attributes.data(), sizeof(PackedVertex::Attributes), vertexCount);
 }
 
-void Model::createIndexBuffers(const std::vector<uint32_t>& indices) {
-	indexCount = static_cast<uint32_t>(indices.size());
+void Model::createIndexBuffers(const uint32_t* indices, uint32_t indexCount) {
+	this->indexCount = indexCount;
 	hasIndexBuffer = indexCount > 0;
-	uint32_t indexSize = sizeof(indices[0]);
 
 	if (!hasIndexBuffer) {
 		return;
 	}
 
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-
-	Buffer stagingBuffer{
-		device, indexSize, indexCount,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	};
+	//every index fits in 16 bits, which covers most props and halves the index memory
+	std::vector<uint16_t> shortIndices;
+	const void* indexData = indices;
+	uint32_t indexSize = sizeof(uint32_t);
+	indexType = VK_INDEX_TYPE_UINT32;
+	if (vertexCount <= 65536) {
+		shortIndices.resize(indexCount);
+		for (uint32_t i = 0; i < indexCount; i++) {
+			shortIndices[i] = static_cast<uint16_t>(indices[i]);
+		}
+		indexData = shortIndices.data();
+		indexSize = sizeof(uint16_t);
+		indexType = VK_INDEX_TYPE_UINT16;
+	}
 
-	stagingBuffer.map();
-	stagingBuffer.writeToBuffer((void*)indices.data());
+	VkDeviceSize bufferSize = static_cast<VkDeviceSize>(indexSize) * indexCount;
 
 	indexBuffer = std::make_unique<Buffer>(
 		device, indexSize, indexCount,
@@ -104,226 +171,433 @@ void Model::createIndexBuffers(const std::vector<uint32_t>& indices) {
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 	);
 
-	device.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);
+	device.uploader().uploadBuffer(indexData, bufferSize, indexBuffer->getBuffer());
 }
 
 std::vector<VkVertexInputBindingDescription> Model::Vertex::getBindingDescriptions() {
-	std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
-	bindingDescriptions[0].binding = 0;
-	bindingDescriptions[0].stride = sizeof(Vertex);
-	bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+	bindingDescriptions.push_back({ 0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX });
+	bindingDescriptions.push_back({ 1, sizeof(Attributes), VK_VERTEX_INPUT_RATE_VERTEX });
 	return bindingDescriptions;
 }
 std::vector<VkVertexInputAttributeDescription> Model::Vertex::getAttributeDescriptions() {
 	std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
 
-	attributeDescriptions.push_back({0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)});
-	attributeDescriptions.push_back({1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)});
-	attributeDescriptions.push_back({2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)});
-	attributeDescriptions.push_back({3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, texCoord)});
+	attributeDescriptions.push_back({0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0});
+	attributeDescriptions.push_back({1, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Attributes, color)});
+	attributeDescriptions.push_back({2, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Attributes, normal)});
+	attributeDescriptions.push_back({3, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(Attributes, texCoord)});
 
 	return attributeDescriptions;
 }
+std::vector<VkVertexInputBindingDescription> Model::Vertex::getPositionBindingDescriptions() {
+	return { { 0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX } };
+}
+std::vector<VkVertexInputAttributeDescription> Model::Vertex::getPositionAttributeDescriptions() {
+	return { { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 } };
+}
 
-void Model::Geometry::loadModel(const std::string& filepath) {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, err;
+std::vector<VkVertexInputBindingDescription> Model::PackedVertex::getBindingDescriptions() {
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+	bindingDescriptions.push_back({ 0, sizeof(Position), VK_VERTEX_INPUT_RATE_VERTEX });
+	bindingDescriptions.push_back({ 1, sizeof(Attributes), VK_VERTEX_INPUT_RATE_VERTEX });
+	return bindingDescriptions;
+}
+std::vector<VkVertexInputAttributeDescription> Model::PackedVertex::getAttributeDescriptions() {
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions = getPositionAttributeDescriptions();
 
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str())) {
-		throw std::runtime_error(warn + err);
+	attributeDescriptions.push_back({2, 1, VK_FORMAT_R16G16_SNORM, offsetof(Attributes, normal)});
+	attributeDescriptions.push_back({3, 1, VK_FORMAT_R16G16_UNORM, offsetof(Attributes, texCoord)});
+
+	return attributeDescriptions;
+}
+std::vector<VkVertexInputBindingDescription> Model::PackedVertex::getPositionBindingDescriptions() {
+	return { { 0, sizeof(Position), VK_VERTEX_INPUT_RATE_VERTEX } };
+}
+std::vector<VkVertexInputAttributeDescription> Model::PackedVertex::getPositionAttributeDescriptions() {
+	//three component 16 bit formats are rarely supported as vertex input, w is padding
+	return { { 0, 0, VK_FORMAT_R16G16B16A16_SNORM, 0 } };
+}
+
+std::vector<VkVertexInputBindingDescription> Model::Instance::getBindingDescriptions() {
+	return { { 3, sizeof(Instance), VK_VERTEX_INPUT_RATE_INSTANCE } };
+}
+std::vector<VkVertexInputAttributeDescription> Model::Instance::getAttributeDescriptions() {
+	//a mat4 takes locations 4 to 7 and the mat3 8 to 10, one column each
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+	for (uint32_t column = 0; column < 4; column++) {
+		attributeDescriptions.push_back({ 4 + column, 3, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(offsetof(Instance, model) + column * sizeof(glm::vec4)) });
+	}
+	for (uint32_t column = 0; column < 3; column++) {
+		attributeDescriptions.push_back({ 8 + column, 3, VK_FORMAT_R32G32B32_SFLOAT, static_cast<uint32_t>(offsetof(Instance, normal) + column * sizeof(glm::vec4)) });
 	}
+	return attributeDescriptions;
+}
 
-	vertices.clear();
-	indices.clear();
+static int16_t toSnorm16(float value) {
+	return static_cast<int16_t>(std::round(std::clamp(value, -1.f, 1.f) * 32767.f));
+}
 
-	std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-	for (const auto& shape : shapes) {
-		for (const auto& index : shape.mesh.indices) {
-			Vertex vertex{};
-
-			if (index.vertex_index >= 0) {
-				vertex.position = {
-					attrib.vertices[3 * index.vertex_index + 0],
-					attrib.vertices[3 * index.vertex_index + 1],
-					attrib.vertices[3 * index.vertex_index + 2],
-				};
-
-				auto colorIndex = 3 * index.vertex_index + 2;
-				if (colorIndex < attrib.colors.size()) {
-					vertex.color = {
-						attrib.colors[colorIndex - 2],
-						attrib.colors[colorIndex - 1],
-						attrib.colors[colorIndex - 0],
-					};
-				}
-				else {
-					vertex.color = { 1.f, 1.f, 1.f };  // set default color
-				}
-			}
-			if (index.normal_index >= 0) {
-				vertex.normal = {
-					attrib.normals[3 * index.normal_index + 0],
-					attrib.normals[3 * index.normal_index + 1],
-					attrib.normals[3 * index.normal_index + 2],
-				};
-			}
+static uint16_t toUnorm16(float value) {
+	return static_cast<uint16_t>(std::round(std::clamp(value, 0.f, 1.f) * 65535.f));
+}
 
-			if (index.texcoord_index >= 0) {
-				vertex.texCoord = {
-					attrib.texcoords[2 * index.texcoord_index + 0],
-					1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-				};
-			}
+//octahedral mapping, the unit sphere folded onto the [-1, 1] square
+static glm::vec2 octEncode(glm::vec3 n) {
+	float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (length == 0.f) {
+		return glm::vec2(0.f);
+	}
+	n /= length;
+	glm::vec2 encoded(n.x, n.y);
+	if (n.z < 0.f) {
+		encoded.x = (1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f);
+		encoded.y = (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f);
+	}
+	return encoded;
+}
 
-			if (uniqueVertices.count(vertex) == 0) {
-				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-				vertices.push_back(vertex);
-			}
-			indices.push_back(uniqueVertices[vertex]);
-		}
+void Model::packVertices(const Vertex* vertices,
+		uint32_t vertexCount,
+		std::vector<PackedVertex::Position>& positions,
+		std::vector<PackedVertex::Attributes>& attributes,
+		Dequantization& dequantization) {
+	glm::vec3 minPosition(0.f), maxPosition(0.f);
+	glm::vec2 minTexCoord(0.f), maxTexCoord(0.f);
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		const Vertex& vertex = vertices[i];
+		minPosition = i == 0 ? vertex.position : glm::min(minPosition, vertex.position);
+		maxPosition = i == 0 ? vertex.position : glm::max(maxPosition, vertex.position);
+		minTexCoord = i == 0 ? vertex.texCoord : glm::min(minTexCoord, vertex.texCoord);
+		maxTexCoord = i == 0 ? vertex.texCoord : glm::max(maxTexCoord, vertex.texCoord);
 	}
+
+	//flat axes keep a unit extent so nothing divides by zero
+	glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+	glm::vec3 extent = (maxPosition - minPosition) * 0.5f;
+	extent = glm::vec3(extent.x > 0.f ? extent.x : 1.f, extent.y > 0.f ? extent.y : 1.f, extent.z > 0.f ? extent.z : 1.f);
+	glm::vec2 texCoordRange = maxTexCoord - minTexCoord;
+	texCoordRange = glm::vec2(texCoordRange.x > 0.f ? texCoordRange.x : 1.f, texCoordRange.y > 0.f ? texCoordRange.y : 1.f);
+
+	dequantization.positionScale = glm::vec4(extent, 1.f);
+	dequantization.positionOffset = glm::vec4(center, 0.f);
+	dequantization.texCoordScaleOffset = glm::vec4(texCoordRange, minTexCoord);
+
+	positions.resize(vertexCount);
+	attributes.resize(vertexCount);
+
+	//generated water and terrain meshes run into millions of vertices
+	const uint32_t chunkSize = 65536;
+	uint32_t chunks = (vertexCount + chunkSize - 1) / chunkSize;
+	ThreadPool::global().parallelFor(chunks, [&](uint32_t chunk) {
+		uint32_t end = std::min(vertexCount, (chunk + 1) * chunkSize);
+		for (uint32_t i = chunk * chunkSize; i < end; i++) {
+			const Vertex& vertex = vertices[i];
+			PackedVertex::Position& outPosition = positions[i];
+			glm::vec3 position = (vertex.position - center) / extent;
+			outPosition.position[0] = toSnorm16(position.x);
+			outPosition.position[1] = toSnorm16(position.y);
+			outPosition.position[2] = toSnorm16(position.z);
+			outPosition.position[3] = 0;
+
+			PackedVertex::Attributes& outAttributes = attributes[i];
+			glm::vec2 normal = octEncode(vertex.normal);
+			outAttributes.normal[0] = toSnorm16(normal.x);
+			outAttributes.normal[1] = toSnorm16(normal.y);
+			glm::vec2 texCoord = (vertex.texCoord - minTexCoord) / texCoordRange;
+			outAttributes.texCoord[0] = toUnorm16(texCoord.x);
+			outAttributes.texCoord[1] = toUnorm16(texCoord.y);
+		}
+	});
 }
 
-Model::HeightMap::HeightMap(Device& device, std::string filename, uint32_t patchsize) {
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(filename.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
+//binary mesh cache layout: header, vertexCount packed Vertex, indexCount uint32_t
+struct MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t padding;
+};
+static constexpr uint32_t meshCacheMagic = 0x48534d56; //"VMSH"
+static constexpr uint32_t meshCacheVersion = 2;
 
-	if (!pixels) {
-		spdlog::critical("Failed to load texture image");
+void Model::Geometry::loadModel(const std::string& filepath) {
+	std::string cachePath = filepath + ".meshcache";
+	if (readCache(filepath, cachePath)) {
+		spdlog::debug("Loaded {} from mesh cache", filepath);
+		return;
 	}
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	device.createBuffer(imageSize, 
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-		stagingBuffer, 
-		stagingBufferMemory);
+	importObj(filepath);
+	optimize(filepath);
+	writeCache(filepath, cachePath);
+}
 
-	void* data;
-	vkMapMemory(device.device(), stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(device.device(), stagingBufferMemory);
+bool Model::Geometry::readCache(const std::string& filepath, const std::string& cachePath) {
+	std::error_code error;
+	if (!std::filesystem::exists(cachePath, error)) {
+		return false;
+	}
 
-	dim = texWidth;
-	heightdata = new uint16_t[dim * dim];
-	this->scale = dim / patchsize;
-	//this->scale = 2;
+	auto file = std::make_shared<MappedFile>(cachePath);
+	if (!file->isOpen() || file->size() < sizeof(MeshCacheHeader)) {
+		return false;
+	}
 
-	stbi_image_free(pixels);
-    vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
-    vkFreeMemory(device.device(), stagingBufferMemory, nullptr);
-};
+	const MeshCacheHeader* header = static_cast<const MeshCacheHeader*>(file->data());
+	uint64_t sourceSize = std::filesystem::file_size(filepath, error);
+	int64_t sourceTime = std::filesystem::last_write_time(filepath, error).time_since_epoch().count();
+	if (error ||
+		header->magic != meshCacheMagic ||
+		header->version != meshCacheVersion ||
+		header->vertexStride != sizeof(Vertex) ||
+		header->sourceSize != sourceSize ||
+		header->sourceTime != sourceTime) {
+		return false;
+	}
 
-float Model::HeightMap::getHeight(uint32_t x, uint32_t y) {
-	glm::ivec2 rpos = glm::ivec2(x, y) * glm::ivec2(scale);
-	rpos.x = std::max(0, std::min(rpos.x, (int)dim-1));
-	rpos.y = std::max(0, std::min(rpos.y, (int)dim-1));
-	rpos /= glm::ivec2(scale);
-	return *(heightdata + (rpos.x + rpos.y * dim) * scale) / 65535.0f;
-}
-
-// Generate a terrain quad patch for feeding to the tessellation control shader
-std::unique_ptr<Model> Model::generateTerrain(Device& device, float patchSize, float uvScale) {
-#define PATCH_SIZE 64
-	const uint32_t vertexCount = PATCH_SIZE * PATCH_SIZE;
-	//Model::Vertex* vertices = new Model::Vertex[vertexCount];
-	std::vector<Model::Vertex> vertices;
-	vertices.resize(vertexCount);
-
-
-	const float wx = 2.0f;
-	const float wy = 2.0f;
-
-	for (auto x = 0; x < PATCH_SIZE; x++) {
-		for (auto y = 0; y < PATCH_SIZE; y++) {
-			uint32_t index = (x + y * PATCH_SIZE);
-			vertices[index].position[0] = x * wx + wx / 2.0f - (float)PATCH_SIZE * wx / 2.0f;
-			vertices[index].position[1] = 0.0f;
-			vertices[index].position[2] = y * wy + wy / 2.0f - (float)PATCH_SIZE * wy / 2.0f;
-			vertices[index].texCoord = glm::vec2((float)x / PATCH_SIZE, (float)y / PATCH_SIZE);
-		//	vertices[index].texCoord = glm::vec2(x % 4, y % 4);
-			vertices[index].color = glm::vec3(1);
-			vertices[index].normal = glm::vec3(1);
-		}
+	size_t vertexBytes = static_cast<size_t>(header->vertexCount) * sizeof(Vertex);
+	size_t indexBytes = static_cast<size_t>(header->indexCount) * sizeof(uint32_t);
+	if (file->size() != sizeof(MeshCacheHeader) + vertexBytes + indexBytes) {
+		spdlog::warn("Mesh cache {} is truncated", cachePath);
+		return false;
 	}
 
-	// Calculate normals from height map using a sobel filter
-	Model::HeightMap heightMap(device, "textures/heightmap.png", PATCH_SIZE);
-	for (auto x = 0; x < PATCH_SIZE; x++) {
-		for (auto y = 0; y < PATCH_SIZE; y++) {
-			float heights[3][3];
-			for (auto hx = -1; hx <= 1; hx++) {
-				for (auto hy = -1; hy <= 1; hy++) {
-					heights[hx + 1][hy + 1] = heightMap.getHeight(x + hx, y + hy);
-				}
-			}
+	//the data stays in the mapping, uploads copy it straight into staging
+	const char* data = static_cast<const char*>(file->data()) + sizeof(MeshCacheHeader);
+	vertices.clear();
+	indices.clear();
+	mappedVertices = reinterpret_cast<const Vertex*>(data);
+	mappedIndices = reinterpret_cast<const uint32_t*>(data + vertexBytes);
+	mappedVertexCount = header->vertexCount;
+	mappedIndexCount = header->indexCount;
+	mapped = file;
+	return true;
+}
 
-			// Calculate the normal
-			glm::vec3 normal;
-			normal.x = heights[0][0] - heights[2][0] + 2.0f * heights[0][1] - 2.0f * heights[2][1] + heights[0][2] - heights[2][2];
-			normal.z = heights[0][0] + 2.0f * heights[1][0] + heights[2][0] - heights[0][2] - 2.0f * heights[1][2] - heights[2][2];
-			normal.y = 0.25f * sqrt(1.0f - normal.x * normal.x - normal.z * normal.z);
+void Model::Geometry::writeCache(const std::string& filepath, const std::string& cachePath) {
+	std::error_code error;
+	MeshCacheHeader header{};
+	header.magic = meshCacheMagic;
+	header.version = meshCacheVersion;
+	header.sourceSize = std::filesystem::file_size(filepath, error);
+	header.sourceTime = std::filesystem::last_write_time(filepath, error).time_since_epoch().count();
+	header.vertexStride = sizeof(Vertex);
+	header.vertexCount = static_cast<uint32_t>(vertices.size());
+	header.indexCount = static_cast<uint32_t>(indices.size());
+	if (error) {
+		return;
+	}
 
-			vertices[x + y * (int)PATCH_SIZE].normal = glm::normalize(normal * glm::vec3(2.0f, 1.0f, 2.0f));
+	//write next to the final name and rename so a crash never leaves a half written cache behind
+	std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			spdlog::warn("Could not write mesh cache {}", cachePath);
+			return;
+		}
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(Vertex));
+		out.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint32_t));
+		if (!out) {
+			spdlog::warn("Could not write mesh cache {}", cachePath);
+			return;
 		}
 	}
+	std::filesystem::rename(tempPath, cachePath, error);
+	if (error) {
+		spdlog::warn("Could not write mesh cache {}: {}", cachePath, error.message());
+		std::filesystem::remove(tempPath, error);
+	}
+}
+
+//open addressing hash of the obj index triple, the triple fully determines the vertex so no float data is hashed
+static uint32_t hashIndex(const tinyobj::index_t& index) {
+	uint64_t hash = static_cast<uint32_t>(index.vertex_index) * 0x9e3779b97f4a7c15ull;
+	hash ^= static_cast<uint32_t>(index.normal_index) * 0xc2b2ae3d27d4eb4full + (hash << 6) + (hash >> 2);
+	hash ^= static_cast<uint32_t>(index.texcoord_index) * 0x165667b19e3779f9ull + (hash << 6) + (hash >> 2);
+	return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
 
-	// Indices
-	const uint32_t w = (PATCH_SIZE - 1);
-	const uint32_t indexCount = w * w * 4;
-	uint32_t* indices = new uint32_t[indexCount];
-	for (auto x = 0; x < w; x++) {
-		for (auto y = 0; y < w; y++) {
-			uint32_t index = (x + y * w) * 4;
-			indices[index] = (x + y * PATCH_SIZE);
-			indices[index + 1] = indices[index] + PATCH_SIZE;
-			indices[index + 2] = indices[index + 1] + 1;
-			indices[index + 3] = indices[index] + 1;
+static Model::Vertex makeVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& index) {
+	Model::Vertex vertex{};
+
+	if (index.vertex_index >= 0) {
+		vertex.position = {
+			attrib.vertices[3 * index.vertex_index + 0],
+			attrib.vertices[3 * index.vertex_index + 1],
+			attrib.vertices[3 * index.vertex_index + 2],
+		};
+
+		auto colorIndex = 3 * index.vertex_index + 2;
+		if (colorIndex < attrib.colors.size()) {
+			vertex.color = {
+				attrib.colors[colorIndex - 2],
+				attrib.colors[colorIndex - 1],
+				attrib.colors[colorIndex - 0],
+			};
+		}
+		else {
+			vertex.color = { 1.f, 1.f, 1.f };  // set default color
 		}
 	}
-	Model::Geometry geometry;
-	//geometry.vertices = std::vector<Model::Vertex>(vertices, vertices + vertexCount);
-	geometry.vertices = vertices;
-	geometry.indices = std::vector<uint32_t>(indices, indices + indexCount);
+	if (index.normal_index >= 0) {
+		vertex.normal = {
+			attrib.normals[3 * index.normal_index + 0],
+			attrib.normals[3 * index.normal_index + 1],
+			attrib.normals[3 * index.normal_index + 2],
+		};
+	}
+
+	if (index.texcoord_index >= 0) {
+		vertex.texCoord = {
+			attrib.texcoords[2 * index.texcoord_index + 0],
+			1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+		};
+	}
+	return vertex;
+}
 
-	//delete[] vertices;
-	delete[] indices;
+static void deduplicateShape(const tinyobj::attrib_t& attrib,
+		const tinyobj::shape_t& shape,
+		std::vector<Model::Vertex>& vertices,
+		std::vector<uint32_t>& indices) {
+	struct Slot {
+		tinyobj::index_t key;
+		uint32_t vertex;
+	};
 
-	return std::make_unique<Model>(device, geometry, AssetManager::textures["sand"]);
+	const auto& shapeIndices = shape.mesh.indices;
+	//at most half full so probe chains stay short
+	size_t capacity = 16;
+	while (capacity < shapeIndices.size() * 2) {
+		capacity <<= 1;
+	}
+	size_t mask = capacity - 1;
+	std::vector<Slot> slots(capacity, { {}, UINT32_MAX });
+
+	vertices.reserve(shapeIndices.size());
+	indices.resize(shapeIndices.size());
+	for (size_t i = 0; i < shapeIndices.size(); i++) {
+		const tinyobj::index_t& index = shapeIndices[i];
+		size_t slot = hashIndex(index) & mask;
+		while (true) {
+			Slot& entry = slots[slot];
+			if (entry.vertex == UINT32_MAX) {
+				entry.key = index;
+				entry.vertex = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(makeVertex(attrib, index));
+				break;
+			}
+			if (entry.key.vertex_index == index.vertex_index &&
+				entry.key.normal_index == index.normal_index &&
+				entry.key.texcoord_index == index.texcoord_index) {
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+		indices[i] = slots[slot].vertex;
+	}
 }
-std::unique_ptr<Model> Model::generateMesh(Device& device, int length, int width, std::shared_ptr<Texture> texture, std::string heightmap) {
-	Model::Geometry geometry;
 
-	int total = 0;
-	//generate length * width squares
-	for (int i = 0; i < length; i++) {
-		for (int j = 0; j < width; j++) {
-			float yPos[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-			Model::Vertex vert1{ {i - .5f, yPos[0], j - .5f}, {1.f, 1.f, 1.f}, {.0f, 1.f, 0.0f}, {1.f, 0.f} };
-			Model::Vertex vert2{ {i - .5f, yPos[1], j + .5f}, {1.f, 1.f, 1.f}, {.0f, 1.f, 0.0f}, {0.f, 0.f} };
-			Model::Vertex vert3{ {i + .5f, yPos[2], j + .5f}, {1.f, 1.f, 1.f}, {.0f, 1.f, 0.0f}, {0.f, 1.f} };
-			Model::Vertex vert4{ {i + .5f, yPos[3], j - .5f}, {1.f, 1.f, 1.f}, {.0f, 1.f, 0.0f}, {1.f, 1.f} };
-
-			geometry.vertices.push_back(vert1);
-			geometry.vertices.push_back(vert2);
-			geometry.vertices.push_back(vert3);
-			geometry.vertices.push_back(vert4);
-
-			//0, 1, 2, 2, 3, 0
-			geometry.indices.push_back((total) * 4);
-			geometry.indices.push_back(1 + (total) * 4);
-			geometry.indices.push_back(2 + (total) * 4);
-			geometry.indices.push_back(2 + (total) * 4);
-			geometry.indices.push_back(3 + (total) * 4);
-			geometry.indices.push_back((total) * 4);
-			total++;
+void Model::Geometry::optimize(const std::string& name) {
+	if (mapped || indices.empty()) {
+		return;
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	auto before = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+
+	MeshOptimizer::optimizeVertexCache(indices, vertices.size());
+	bool overdraw = MeshOptimizer::optimizeOverdraw(indices, &vertices[0].position.x, vertices.size(), sizeof(Vertex));
+	vertices.resize(MeshOptimizer::optimizeVertexFetch(vertices.data(), indices, vertices.size(), sizeof(Vertex)));
+
+	auto after = MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+	spdlog::debug("Optimized {} in {:.1f}ms: ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}{}",
+		name,
+		std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count(),
+		before.acmr, after.acmr,
+		before.atvr, after.atvr,
+		overdraw ? ", overdraw sorted" : "");
+}
+
+void Model::Geometry::importObj(const std::string& filepath) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str())) {
+		throw std::runtime_error(warn + err);
+	}
+	auto parsed = std::chrono::high_resolution_clock::now();
+
+	vertices.clear();
+	indices.clear();
+	mapped.reset();
+
+	//shapes are deduplicated independently, then concatenated with their vertex offsets applied
+	std::vector<std::vector<Vertex>> shapeVertices(shapes.size());
+	std::vector<std::vector<uint32_t>> shapeIndices(shapes.size());
+	ThreadPool::global().parallelFor(static_cast<uint32_t>(shapes.size()), [&](uint32_t i) {
+		deduplicateShape(attrib, shapes[i], shapeVertices[i], shapeIndices[i]);
+	});
+
+	if (shapes.size() == 1) {
+		vertices = std::move(shapeVertices[0]);
+		indices = std::move(shapeIndices[0]);
+		vertices.shrink_to_fit();
+	}
+	else {
+		size_t vertexTotal = 0, indexTotal = 0;
+		for (size_t i = 0; i < shapes.size(); i++) {
+			vertexTotal += shapeVertices[i].size();
+			indexTotal += shapeIndices[i].size();
+		}
+		vertices.reserve(vertexTotal);
+		indices.reserve(indexTotal);
+		for (size_t i = 0; i < shapes.size(); i++) {
+			uint32_t offset = static_cast<uint32_t>(vertices.size());
+			vertices.insert(vertices.end(), shapeVertices[i].begin(), shapeVertices[i].end());
+			for (uint32_t index : shapeIndices[i]) {
+				indices.push_back(index + offset);
+			}
 		}
 	}
 
-	return std::make_unique<Model>(device, geometry, texture);
+	auto done = std::chrono::high_resolution_clock::now();
+	spdlog::debug("Imported {}: parse {:.1f}ms, deduplicate {:.1f}ms, {} vertices, {} indices",
+		filepath,
+		std::chrono::duration<float, std::chrono::milliseconds::period>(parsed - start).count(),
+		std::chrono::duration<float, std::chrono::milliseconds::period>(done - parsed).count(),
+		vertices.size(),
+		indices.size());
 }
 
+std::unique_ptr<Model> Model::generateMesh(Device& device, int length, int width, std::shared_ptr<Texture> texture, std::string heightmap) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	//length * width unit cells centered on integer coordinates, neighbouring cells share their vertices
+	GridGenerator::GridInfo info{};
+	info.cellsX = static_cast<uint32_t>(length);
+	info.cellsZ = static_cast<uint32_t>(width);
+	info.origin = glm::vec2(-.5f);
+
+	Model::Geometry geometry;
+	GridGenerator::generate(info, geometry);
+
+	spdlog::debug("Generated {}x{} grid in {:.1f}ms: {} vertices, {} indices",
+		length,
+		width,
+		std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count(),
+		geometry.vertices.size(),
+		geometry.indices.size());
+
+	return std::make_unique<Model>(device, geometry, texture, VertexFormat::Packed);
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -9,6 +10,7 @@
 
 #include "device.h"
 #include "buffer.h"
+#include "mappedFile.h"
 #include "texture.h"
 
 class Model {
@@ -19,35 +21,94 @@ public:
 		glm::vec3 normal{};
 		glm::vec2 texCoord;
 
+		//on the gpu positions are binding 0 and the shading attributes binding 1
+		struct Attributes {
+			glm::vec3 color;
+			glm::vec3 normal;
+			glm::vec2 texCoord;
+		};
+
 		static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
 		static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+		//depth only, shadow and picking pipelines fetch nothing but binding 0
+		static std::vector<VkVertexInputBindingDescription> getPositionBindingDescriptions();
+		static std::vector<VkVertexInputAttributeDescription> getPositionAttributeDescriptions();
 
 		bool operator==(const Vertex &other) const {
 			return position == other.position && normal == other.normal && color == other.color && texCoord == other.texCoord;
 		}
 	};
 
+	//full float vertices or the 16 byte quantized layout, chosen per model
+	enum class VertexFormat {
+		Full,
+		Packed
+	};
+
+	//snorm16 position relative to the mesh bounds, octahedral snorm16 normal, unorm16 uv relative to the uv bounds
+	struct PackedVertex {
+		struct Position {
+			int16_t position[4];
+		};
+		struct Attributes {
+			int16_t normal[2];
+			uint16_t texCoord[2];
+		};
+
+		//same stream split as Vertex, vertex colors aren't read by any shader so they are dropped
+		static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
+		static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+		static std::vector<VkVertexInputBindingDescription> getPositionBindingDescriptions();
+		static std::vector<VkVertexInputAttributeDescription> getPositionAttributeDescriptions();
+	};
+
+	//push constant turning the normalized packed attributes back into mesh space
+	struct Dequantization {
+		glm::vec4 positionScale{ 1.f };
+		glm::vec4 positionOffset{ 0.f };
+		glm::vec4 texCoordScaleOffset{ 1.f, 1.f, 0.f, 0.f };
+	};
+
+	//per instance stream of instanced draws at binding 3, next to either vertex layout
+	//the normal matrix comes precomputed instead of being inverted per vertex, its columns are padded to vec4
+	struct Instance {
+		glm::mat4 model;
+		glm::vec4 normal[3];
+
+		static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
+		static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+	};
+
 	struct Geometry {
 		std::vector<Vertex> vertices{};
 		std::vector<uint32_t> indices{};
 
+		//reads the binary mesh cache next to the obj when it is current, otherwise imports and writes it
 		void loadModel(const std::string& filepath);
-	};
+		//always parses the obj, shapes are deduplicated in parallel
+		void importObj(const std::string& filepath);
+		//vertex cache, overdraw and vertex fetch reordering of a triangle list
+		void optimize(const std::string& name);
+
+		//point into the mapped cache file when loaded from it, otherwise into the vectors
+		const Vertex* vertexData() const { return mapped ? mappedVertices : vertices.data(); }
+		uint32_t vertexCount() const { return mapped ? mappedVertexCount : static_cast<uint32_t>(vertices.size()); }
+		const uint32_t* indexData() const { return mapped ? mappedIndices : indices.data(); }
+		uint32_t indexCount() const { return mapped ? mappedIndexCount : static_cast<uint32_t>(indices.size()); }
 
-	struct HeightMap {
 	private:
-		uint16_t *heightdata;
-		uint32_t dim;
-		uint32_t scale;
-	public:
-		HeightMap(Device& device, std::string filename, uint32_t patchsize);
-		~HeightMap() {	delete[] heightdata; }
-
-		float getHeight(uint32_t x, uint32_t y);
+		std::shared_ptr<MappedFile> mapped;
+		const Vertex* mappedVertices = nullptr;
+		const uint32_t* mappedIndices = nullptr;
+		uint32_t mappedVertexCount = 0;
+		uint32_t mappedIndexCount = 0;
+
+		bool readCache(const std::string& filepath, const std::string& cachePath);
+		void writeCache(const std::string& filepath, const std::string& cachePath);
 	};
 
 
-	Model(Device &device, const Model::Geometry& geometry, std::shared_ptr<Texture> texture);
+	Model(Device &device, const Model::Geometry& geometry, std::shared_ptr<Texture> texture, VertexFormat format = VertexFormat::Full);
 	~Model();
 
 	//delete copy constructors
@@ -55,27 +116,59 @@ public:
 	Model& operator=(const Model&) = delete;
 
 	void bind(VkCommandBuffer commandBuffer);
-	void draw(VkCommandBuffer commandBuffer);
-
-	static std::unique_ptr<Model> createModelFromFile(Device& device, const std::string& filepath, std::shared_ptr<Texture> texture);
-	static std::unique_ptr<Model> generateTerrain(Device& device, float patchSize, float uvScale);
+	//only the position stream and the index buffer
+	void bindPositions(VkCommandBuffer commandBuffer);
+	void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+	//reads a VkDrawIndexedIndirectCommand at offset for indexed models, a VkDrawIndirectCommand otherwise
+	void drawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset);
+	//the matching indirect command with no instances, instanceCount is the second uint in both layouts
+	void writeIndirectCommand(uint32_t command[5]) const;
+
+	static std::unique_ptr<Model> createModelFromFile(Device& device, const std::string& filepath, std::shared_ptr<Texture> texture, VertexFormat format = VertexFormat::Full);
 	static std::unique_ptr<Model> generateMesh(Device& device, int length, int width, std::shared_ptr<Texture> texture, std::string heightmap = "");
 
 	std::shared_ptr<Texture> getTexture() { return texture; }
+	VertexFormat getVertexFormat() const { return format; }
+	VkIndexType getIndexType() const { return indexType; }
+	const Dequantization& getDequantization() const { return dequantization; }
+	//mesh space center and radius enclosing every vertex
+	const glm::vec4& getBoundingSphere() const { return boundingSphere; }
+	//mesh space box around every vertex
+	const glm::vec3& getBoundsMin() const { return boundsMin; }
+	const glm::vec3& getBoundsMax() const { return boundsMax; }
+
+	//quantizes into the packed streams
+	static void packVertices(const Vertex* vertices,
+		uint32_t vertexCount,
+		std::vector<PackedVertex::Position>& positions,
+		std::vector<PackedVertex::Attributes>& attributes,
+		Dequantization& dequantization);
 private:
 	Device& device;
 
-	std::unique_ptr<Buffer> vertexBuffer;
+	VertexFormat format;
+	Dequantization dequantization{};
+
+	std::unique_ptr<Buffer> positionBuffer;
+	std::unique_ptr<Buffer> attributeBuffer;
 	int32_t vertexCount;
 
 	bool hasIndexBuffer = false;
 	std::unique_ptr<Buffer> indexBuffer;
 	uint32_t indexCount;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
 
 	std::shared_ptr<Texture> texture;
+	glm::vec4 boundingSphere{ 0.f };
+	glm::vec3 boundsMin{ 0.f };
+	glm::vec3 boundsMax{ 0.f };
 
+	void computeBounds(const Vertex* vertices, uint32_t vertexCount);
 
-	void createVertexBuffers(const std::vector<Vertex> &vertices);
-	void createIndexBuffers(const std::vector<uint32_t>& indices);
+	std::unique_ptr<Buffer> createVertexStream(const void* data, uint32_t stride, uint32_t vertexCount);
+	void createVertexBuffers(const Vertex* vertices, uint32_t vertexCount);
+	void createPackedVertexBuffers(const Vertex* vertices, uint32_t vertexCount);
+	//needs vertexCount, uint16 indices whenever the mesh has at most 65536 vertices
+	void createIndexBuffers(const uint32_t* indices, uint32_t indexCount);
 };
 
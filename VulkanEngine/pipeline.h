@@ -6,6 +6,8 @@
 #include "device.h"
 
 struct PipelineConfigInfo {
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
 	VkPipelineViewportStateCreateInfo viewportInfo;
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
 	VkPipelineRasterizationStateCreateInfo rasterizationInfo;
@@ -36,6 +38,9 @@ public:
 
 	static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
 	void bind(VkCommandBuffer commandBuffer);
+
+	//helper functions
+	static std::vector<char> readFile(const std::string& filepath);
 private:
 	Device& device;
 	VkPipeline graphicsPipeline;
@@ -51,8 +56,5 @@ private:
 		const std::string& teseFilepath = "",
 		const std::string& tescFIlepath = "");
 	void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
-
-	//helper functions
-	static std::vector<char> readFile(const std::string& filepath);
 };
 
@@ -26,19 +26,35 @@
 #include "assetManager.h"
 
 namespace PythonManager {
+	static PyObject* tagList(const std::vector<uint32_t>& objects) {
+		PyObject* listObj = PyList_New(0);
+		for (uint32_t object : objects) {
+			PyObject* tag = Py_BuildValue("s", Engine::gameObjects[object].getTag().c_str());
+			PyList_Append(listObj, tag);
+			Py_DECREF(tag);
+		}
+		return listObj;
+	}
+
+	//writes the tagged object's transform and queues it for the scene tree, both under the lock the frame syncs with
+	template<typename Change>
+	static void changeTransform(const char* tag, Change change) {
+		std::lock_guard<std::mutex> lock(Engine::mtx);
+		int32_t index = Engine::sceneTree.find(Engine::gameObjects, tag);
+		if (index < 0) {
+			spdlog::critical("No such tag exists {}", tag);
+			return;
+		}
+		change(Engine::gameObjects[index].transform);
+		Engine::sceneTree.markMoved(index);
+	}
+
 	//python methods to interact with engine
 	static PyObject* change_scale(PyObject* self, PyObject* args) {
 		char* tag;
 		float scaleX, scaleY, scaleZ;
 		if (PyArg_ParseTuple(args, "sfff", &tag, &scaleX, &scaleY, &scaleZ)) {
-			auto it = std::find_if(std::begin(Engine::gameObjects), std::end(Engine::gameObjects), [&](GameObject const& obj) { return obj.getTag() == tag; });
-			auto index = std::distance(Engine::gameObjects.begin(), it);
-			if (index < 0 || index >= Engine::gameObjects.size()) {
-				spdlog::critical("No such tag exists {}", tag);
-			}
-			else {
-				Engine::gameObjects[index].transform.scale = glm::vec3(scaleX, scaleY, scaleZ);
-			}
+			changeTransform(tag, [&](TransformComponent& transform) { transform.scale = glm::vec3(scaleX, scaleY, scaleZ); });
 		}
 
 		return PyLong_FromLong(0);
@@ -48,14 +64,7 @@ namespace PythonManager {
 		char* tag;
 		float translationX, translationY, translationZ;
 		if (PyArg_ParseTuple(args, "sfff", &tag, &translationX, &translationY, &translationZ)) {
-			auto it = std::find_if(std::begin(Engine::gameObjects), std::end(Engine::gameObjects), [&](GameObject const& obj) { return obj.getTag() == tag; });
-			auto index = std::distance(Engine::gameObjects.begin(), it);
-			if (index < 0 || index >= Engine::gameObjects.size()) {
-				spdlog::critical("No such tag exists {}", tag);
-			}
-			else {
-				Engine::gameObjects[index].transform.translation = glm::vec3(translationX, translationY, translationZ);
-			}
+			changeTransform(tag, [&](TransformComponent& transform) { transform.translation = glm::vec3(translationX, translationY, translationZ); });
 		}
 
 		return PyLong_FromLong(0);
@@ -65,14 +74,7 @@ namespace PythonManager {
 		char* tag;
 		float rotationX, rotationY, rotationZ;
 		if (PyArg_ParseTuple(args, "sfff", &tag, &rotationX, &rotationY, &rotationZ)) {
-			auto it = std::find_if(std::begin(Engine::gameObjects), std::end(Engine::gameObjects), [&](GameObject const& obj) { return obj.getTag() == tag; });
-			auto index = std::distance(Engine::gameObjects.begin(), it);
-			if (index < 0 || index >= Engine::gameObjects.size()) {
-				spdlog::critical("No such tag exists {}", tag);
-			}
-			else {
-				Engine::gameObjects[index].transform.rotation = glm::vec3(rotationX, rotationY, rotationZ);
-			}
+			changeTransform(tag, [&](TransformComponent& transform) { transform.rotation = glm::vec3(rotationX, rotationY, rotationZ); });
 		}
 
 		return PyLong_FromLong(0);
@@ -136,6 +138,212 @@ namespace PythonManager {
 		return PyBool_FromLong(0);
 	}
 
+	static PyObject* get_memory_stats(PyObject* self, PyObject* args) {
+		AllocatorStats stats;
+		{
+			std::lock_guard<std::mutex> lock(Engine::mtx);
+			stats = Engine::memoryStats;
+		}
+		return Py_BuildValue("{s:I,s:I,s:I,s:K,s:K,s:K,s:f}",
+			"blocks", stats.blockCount,
+			"dedicated_blocks", stats.dedicatedBlockCount,
+			"allocations", stats.allocationCount,
+			"bytes_reserved", (unsigned long long)stats.bytesReserved,
+			"bytes_used", (unsigned long long)stats.bytesUsed,
+			"largest_free_range", (unsigned long long)stats.largestFreeRange,
+			"fragmentation", stats.fragmentation);
+	}
+
+	static PyObject* get_culling_stats(PyObject* self, PyObject* args) {
+		RenderManager::CullingStats stats;
+		{
+			std::lock_guard<std::mutex> lock(Engine::mtx);
+			stats = Engine::cullingStats;
+		}
+		return Py_BuildValue("{s:I,s:I,s:I,s:I}",
+			"objects", stats.objects,
+			"gpu_tested", stats.gpuTested,
+			"frustum_culled", stats.frustumCulled,
+			"occlusion_culled", stats.occlusionCulled);
+	}
+
+	//spatial queries against the world boxes of the objects as of the last frame
+	//skybox, terrain and water aren't part of them, the terrain queries below cover the ground
+	static PyObject* get_objects_in_sphere(PyObject* self, PyObject* args) {
+		float x, y, z, radius;
+		if (!PyArg_ParseTuple(args, "ffff", &x, &y, &z, &radius)) {
+			return NULL;
+		}
+		std::lock_guard<std::mutex> lock(Engine::mtx);
+		std::vector<uint32_t> objects;
+		Engine::sceneTree.querySphere(glm::vec3(x, y, z), radius, objects);
+		return tagList(objects);
+	}
+
+	static PyObject* get_objects_in_box(PyObject* self, PyObject* args) {
+		float minX, minY, minZ, maxX, maxY, maxZ;
+		if (!PyArg_ParseTuple(args, "ffffff", &minX, &minY, &minZ, &maxX, &maxY, &maxZ)) {
+			return NULL;
+		}
+		std::lock_guard<std::mutex> lock(Engine::mtx);
+		std::vector<uint32_t> objects;
+		Engine::sceneTree.queryBox(glm::vec3(minX, minY, minZ), glm::vec3(maxX, maxY, maxZ), objects);
+		return tagList(objects);
+	}
+
+	static PyObject* raycast(PyObject* self, PyObject* args) {
+		float originX, originY, originZ, directionX, directionY, directionZ;
+		float maxDistance = 1000.f;
+		if (!PyArg_ParseTuple(args, "ffffff|f", &originX, &originY, &originZ, &directionX, &directionY, &directionZ, &maxDistance)) {
+			return NULL;
+		}
+		std::lock_guard<std::mutex> lock(Engine::mtx);
+		SceneTree::RayHit hit;
+		if (!Engine::sceneTree.raycast(glm::vec3(originX, originY, originZ), glm::vec3(directionX, directionY, directionZ), maxDistance, hit)) {
+			Py_RETURN_NONE;
+		}
+		return Py_BuildValue("(sf)", Engine::gameObjects[hit.object].getTag().c_str(), hit.distance);
+	}
+
+	//world space terrain queries, the terrain is queried in the space of the terrain game object
+	struct TerrainSpace {
+		glm::mat4 toWorld{ 1.f };
+		glm::mat4 toLocal{ 1.f };
+	};
+
+	//a tilted terrain is not directly below the world x, z, a few steps re-project along the world vertical
+	static constexpr int terrainRefinements = 2;
+
+	static bool getTerrainSpace(TerrainSpace& space) {
+		if (!Engine::terrain) {
+			spdlog::critical("No terrain to query");
+			PyErr_SetString(PyExc_RuntimeError, "no terrain");
+			return false;
+		}
+		//add_game_object may reallocate the object list, so look up and copy under one lock
+		std::lock_guard<std::mutex> lock(Engine::mtx);
+		int32_t index = Engine::sceneTree.find(Engine::gameObjects, "terrain");
+		if (index >= 0) {
+			space.toWorld = Engine::gameObjects[index].transform.mat4();
+			space.toLocal = glm::inverse(space.toWorld);
+		}
+		return true;
+	}
+
+	//local xz where the world vertical through x, z crosses the plane at world height y
+	static glm::vec2 terrainLocal(const TerrainSpace& space, float x, float y, float z) {
+		glm::vec4 local = space.toLocal * glm::vec4(x, y, z, 1.f);
+		return glm::vec2(local.x, local.z);
+	}
+
+	static float terrainWorldHeight(const TerrainSpace& space, glm::vec2 local, float height) {
+		return (space.toWorld * glm::vec4(local.x, height, local.y, 1.f)).y;
+	}
+
+	//local xz and height of the surface point under a world x, z
+	static glm::vec2 terrainSurface(const TerrainSpace& space, float x, float z, float& height) {
+		glm::vec2 local = terrainLocal(space, x, space.toWorld[3].y, z);
+		height = Engine::terrain->getHeight(local.x, local.y);
+		for (int i = 0; i < terrainRefinements; i++) {
+			local = terrainLocal(space, x, terrainWorldHeight(space, local, height), z);
+			height = Engine::terrain->getHeight(local.x, local.y);
+		}
+		return local;
+	}
+
+	static PyObject* get_terrain_height(PyObject* self, PyObject* args) {
+		float x, z;
+		TerrainSpace space;
+		if (!PyArg_ParseTuple(args, "ff", &x, &z) || !getTerrainSpace(space)) {
+			return NULL;
+		}
+		try {
+			float height;
+			glm::vec2 local = terrainSurface(space, x, z, height);
+			return PyFloat_FromDouble(terrainWorldHeight(space, local, height));
+		}
+		catch (const std::exception& e) {
+			PyErr_SetString(PyExc_RuntimeError, e.what());
+			return NULL;
+		}
+	}
+
+	static PyObject* get_terrain_normal(PyObject* self, PyObject* args) {
+		float x, z;
+		TerrainSpace space;
+		if (!PyArg_ParseTuple(args, "ff", &x, &z) || !getTerrainSpace(space)) {
+			return NULL;
+		}
+		try {
+			float height;
+			glm::vec2 local = terrainSurface(space, x, z, height);
+			glm::vec3 normal = Engine::terrain->getNormal(local.x, local.y);
+			normal = glm::normalize(glm::transpose(glm::mat3(space.toLocal)) * normal);
+			return Py_BuildValue("(fff)", normal.x, normal.y, normal.z);
+		}
+		catch (const std::exception& e) {
+			PyErr_SetString(PyExc_RuntimeError, e.what());
+			return NULL;
+		}
+	}
+
+	//takes a sequence of (x, z) pairs and returns the list of heights, much cheaper than one call per position
+	static PyObject* get_terrain_heights(PyObject* self, PyObject* args) {
+		PyObject* positionsObj;
+		TerrainSpace space;
+		if (!PyArg_ParseTuple(args, "O", &positionsObj) || !getTerrainSpace(space)) {
+			return NULL;
+		}
+		PyObject* sequence = PySequence_Fast(positionsObj, "expected a sequence of (x, z) pairs");
+		if (!sequence) {
+			return NULL;
+		}
+
+		Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+		std::vector<glm::vec2> world(count);
+		for (Py_ssize_t i = 0; i < count; i++) {
+			if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(sequence, i), "ff", &world[i].x, &world[i].y)) {
+				Py_DECREF(sequence);
+				return NULL;
+			}
+		}
+		Py_DECREF(sequence);
+
+		std::vector<glm::vec2> positions(count);
+		std::vector<float> heights(count);
+		bool failed = false;
+		std::string error;
+		//the queries don't touch python, other python threads may run meanwhile
+		Py_BEGIN_ALLOW_THREADS
+		try {
+			for (Py_ssize_t i = 0; i < count; i++) {
+				positions[i] = terrainLocal(space, world[i].x, space.toWorld[3].y, world[i].y);
+			}
+			Engine::terrain->getHeights(positions.data(), heights.data(), heights.size());
+			for (int refinement = 0; refinement < terrainRefinements; refinement++) {
+				for (Py_ssize_t i = 0; i < count; i++) {
+					positions[i] = terrainLocal(space, world[i].x, terrainWorldHeight(space, positions[i], heights[i]), world[i].y);
+				}
+				Engine::terrain->getHeights(positions.data(), heights.data(), heights.size());
+			}
+		}
+		catch (const std::exception& e) {
+			failed = true;
+			error = e.what();
+		}
+		Py_END_ALLOW_THREADS
+		if (failed) {
+			PyErr_SetString(PyExc_RuntimeError, error.c_str());
+			return NULL;
+		}
+
+		PyObject* listObj = PyList_New(count);
+		for (Py_ssize_t i = 0; i < count; i++) {
+			PyList_SET_ITEM(listObj, i, PyFloat_FromDouble(terrainWorldHeight(space, positions[i], heights[i])));
+		}
+		return listObj;
+	}
+
 	//helper methods python/c++ interaction
 	static struct PyMethodDef methods[] = {
 		{ "change_scale", change_scale, METH_VARARGS, "test print method"},
@@ -147,6 +355,14 @@ namespace PythonManager {
 		{ "get_cur_image", get_cur_image, METH_VARARGS, "test print method"},
 		{ "get_key_down", get_key_down, METH_VARARGS, "test print method"},
 		{ "change_light_pos", change_light_pos, METH_VARARGS, "test print method"},
+		{ "get_memory_stats", get_memory_stats, METH_VARARGS, "gpu memory allocator statistics"},
+		{ "get_culling_stats", get_culling_stats, METH_VARARGS, "objects tested and culled by the last frame"},
+		{ "get_objects_in_sphere", get_objects_in_sphere, METH_VARARGS, "tags of the objects whose bounds overlap a sphere x, y, z, radius"},
+		{ "get_objects_in_box", get_objects_in_box, METH_VARARGS, "tags of the objects whose bounds overlap a box min x, y, z, max x, y, z"},
+		{ "raycast", raycast, METH_VARARGS, "(tag, distance) of the closest object bounds along a ray, or None"},
+		{ "get_terrain_height", get_terrain_height, METH_VARARGS, "terrain surface y at a world x, z"},
+		{ "get_terrain_normal", get_terrain_normal, METH_VARARGS, "terrain normal at a world x, z, pointing towards -y"},
+		{ "get_terrain_heights", get_terrain_heights, METH_VARARGS, "terrain surface y for a sequence of world (x, z) pairs"},
 		{ NULL, NULL, 0, NULL }
 	};
 
@@ -3,6 +3,9 @@
 #include <stdexcept>
 #include <iostream>
 #include <thread>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
 
 #include "spdlog/spdlog.h"
 
@@ -17,41 +20,81 @@
 #include "constants.h"
 #include "engine.h"
 #include "descriptorManager.h"
+#include "threadPool.h"
 
 
-RenderManager::RenderManager(Device& device, VkRenderPass renderPass) : device{ device } {
+RenderManager::RenderManager(Device& device, Renderer& renderer, VkRenderPass renderPass) : device{ device } {
 	createPipelineLayout();
 	createPipeline(renderPass);
+	gpuCulling = std::make_unique<GpuCulling>(device);
+	depthPyramid = std::make_unique<DepthPyramid>(device, renderer);
 }
 
 RenderManager::~RenderManager() {
 	vkDestroyPipelineLayout(device.device(), pipelineLayouts.object, nullptr);
 	vkDestroyPipelineLayout(device.device(), pipelineLayouts.terrain, nullptr);
+	vkDestroyPipelineLayout(device.device(), pipelineLayouts.water, nullptr);
 }
 
 
 void RenderManager::createPipelineLayout() {
+	VkPushConstantRange dequantizationRange{};
+	dequantizationRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	dequantizationRange.offset = 0;
+	dequantizationRange.size = sizeof(Model::Dequantization);
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = 1;
 	pipelineLayoutInfo.pSetLayouts = &DescriptorManager::descriptorSetLayouts.object;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &dequantizationRange;
 
 	if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayouts.object) != VK_SUCCESS) {
 		spdlog::critical("Failed to create pipeline layout");
 		throw std::runtime_error("createPipelineLayout");
 	}
 
+	//terrain nodes push their placement after the dequantization constants, the tessellation stages read it too
+	VkPushConstantRange nodeRange{};
+	nodeRange.stageFlags = Terrain::nodeStages;
+	nodeRange.offset = sizeof(Model::Dequantization);
+	nodeRange.size = sizeof(Terrain::NodePush);
+	std::array<VkPushConstantRange, 2> terrainRanges = { dequantizationRange, nodeRange };
+
+	//set 1 holds the height texture of the tile a node belongs to
+	std::array<VkDescriptorSetLayout, 2> terrainSetLayouts = { DescriptorManager::descriptorSetLayouts.terrain, DescriptorManager::descriptorSetLayouts.terrainTile };
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo2{};
 	pipelineLayoutInfo2.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo2.setLayoutCount = 1;
-	pipelineLayoutInfo2.pSetLayouts = &DescriptorManager::descriptorSetLayouts.terrain;
-	pipelineLayoutInfo2.pushConstantRangeCount = 0;
+	pipelineLayoutInfo2.setLayoutCount = static_cast<uint32_t>(terrainSetLayouts.size());
+	pipelineLayoutInfo2.pSetLayouts = terrainSetLayouts.data();
+	pipelineLayoutInfo2.pushConstantRangeCount = static_cast<uint32_t>(terrainRanges.size());
+	pipelineLayoutInfo2.pPushConstantRanges = terrainRanges.data();
 
 	if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo2, nullptr, &pipelineLayouts.terrain) != VK_SUCCESS) {
 		spdlog::critical("Failed to create pipeline layout");
 		throw std::runtime_error("createPipelineLayout");
 	}
+
+	//water chunks push their clipmap placement after the dequantization constants
+	VkPushConstantRange waterRange = dequantizationRange;
+	waterRange.size = sizeof(Model::Dequantization) + sizeof(WaterSurface::ChunkPush);
+
+	//set 1 holds the textures written by the wave compute pass
+	std::array<VkDescriptorSetLayout, 2> waterSetLayouts = { DescriptorManager::descriptorSetLayouts.object, DescriptorManager::descriptorSetLayouts.waves };
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo3{};
+	pipelineLayoutInfo3.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo3.setLayoutCount = static_cast<uint32_t>(waterSetLayouts.size());
+	pipelineLayoutInfo3.pSetLayouts = waterSetLayouts.data();
+	pipelineLayoutInfo3.pushConstantRangeCount = 1;
+	pipelineLayoutInfo3.pPushConstantRanges = &waterRange;
+
+	if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo3, nullptr, &pipelineLayouts.water) != VK_SUCCESS) {
+		spdlog::critical("Failed to create pipeline layout");
+		throw std::runtime_error("createPipelineLayout");
+	}
 }
 void RenderManager::createPipeline(VkRenderPass renderPass) {
 	//skybox
@@ -62,6 +105,9 @@ void RenderManager::createPipeline(VkRenderPass renderPass) {
 	pipelineConfigCube.rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
 	pipelineConfigCube.depthStencilInfo.depthWriteEnable = VK_FALSE;
 	pipelineConfigCube.depthStencilInfo.depthTestEnable = VK_FALSE;
+	//the skybox only reads positions
+	pipelineConfigCube.bindingDescriptions = Model::Vertex::getPositionBindingDescriptions();
+	pipelineConfigCube.attributeDescriptions = Model::Vertex::getPositionAttributeDescriptions();
 	pipelines[0] = std::make_unique<Pipeline>(device, "shaders/cubemapvert.spv", "shaders/cubemapfrag.spv", pipelineConfigCube);
 
 	//3d objects
@@ -72,80 +118,227 @@ void RenderManager::createPipeline(VkRenderPass renderPass) {
 	pipelineConfig.rasterizationInfo.cullMode = VK_CULL_MODE_BACK_BIT;
 	pipelineConfig.depthStencilInfo.depthWriteEnable = VK_TRUE;
 	pipelineConfig.depthStencilInfo.depthTestEnable = VK_TRUE;
+	//objects are drawn instanced, their transforms come from the instance stream
+	auto instanceBindings = Model::Instance::getBindingDescriptions();
+	auto instanceAttributes = Model::Instance::getAttributeDescriptions();
+	pipelineConfig.bindingDescriptions.insert(pipelineConfig.bindingDescriptions.end(), instanceBindings.begin(), instanceBindings.end());
+	pipelineConfig.attributeDescriptions.insert(pipelineConfig.attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
 	pipelines[1] = std::make_unique<Pipeline>(device, "shaders/vert.spv", "shaders/frag.spv", pipelineConfig);
 
+	PipelineConfigInfo pipelineConfigPacked = pipelineConfig;
+	pipelineConfigPacked.bindingDescriptions = Model::PackedVertex::getBindingDescriptions();
+	pipelineConfigPacked.attributeDescriptions = Model::PackedVertex::getAttributeDescriptions();
+	pipelineConfigPacked.bindingDescriptions.insert(pipelineConfigPacked.bindingDescriptions.end(), instanceBindings.begin(), instanceBindings.end());
+	pipelineConfigPacked.attributeDescriptions.insert(pipelineConfigPacked.attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
+	pipelines[4] = std::make_unique<Pipeline>(device, "shaders/vertpacked.spv", "shaders/frag.spv", pipelineConfigPacked);
+
 	//water
 	PipelineConfigInfo pipelineConfigWater{};
 	Pipeline::defaultPipelineConfigInfo(pipelineConfigWater);
 	pipelineConfigWater.renderPass = renderPass;
-	pipelineConfigWater.pipelineLayout = pipelineLayouts.object;
-	pipelines[2] = std::make_unique<Pipeline>(device, "shaders/watervert.spv", "shaders/waterfrag.spv", pipelineConfigWater);
+	pipelineConfigWater.pipelineLayout = pipelineLayouts.water;
+	pipelineConfigWater.bindingDescriptions = Model::PackedVertex::getBindingDescriptions();
+	pipelineConfigWater.attributeDescriptions = Model::PackedVertex::getAttributeDescriptions();
+	pipelines[2] = std::make_unique<Pipeline>(device, "shaders/watervertpacked.spv", "shaders/waterfrag.spv", pipelineConfigWater);
 
 	//terrain 
 	PipelineConfigInfo pipelineConfigTerrain{};
 	Pipeline::defaultPipelineConfigInfo(pipelineConfigTerrain);
 	pipelineConfigTerrain.renderPass = renderPass;
 	pipelineConfigTerrain.pipelineLayout = pipelineLayouts.terrain;
-	pipelines[3] = std::make_unique<Pipeline>(device, "shaders/terrainvert.spv", "shaders/terrainfrag.spv", pipelineConfigTerrain, "shaders/tese.spv", "shaders/tesc.spv");
+	pipelineConfigTerrain.bindingDescriptions = Model::PackedVertex::getBindingDescriptions();
+	pipelineConfigTerrain.attributeDescriptions = Model::PackedVertex::getAttributeDescriptions();
+	pipelines[3] = std::make_unique<Pipeline>(device, "shaders/terrainvertpacked.spv", "shaders/terrainfrag.spv", pipelineConfigTerrain, "shaders/tese.spv", "shaders/tesc.spv");
 }
 
 
-void RenderManager::renderGameObjects(VkCommandBuffer commandBuffer, 
-		std::vector<GameObject>& gameObjects, 
-		const Camera& camera, std::vector<VkDeviceMemory> uniformBuffersMemory) {
+uint32_t RenderManager::writeUniform(Buffer& uniformBuffer, void* data, VkDeviceSize size, uint32_t slot) {
+	uniformBuffer.writeToIndex(data, slot, size);
+	return static_cast<uint32_t>(slot * uniformBuffer.getAlignmentSize());
+}
+
+void RenderManager::bindModel(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, Model& model) {
+	model.bind(commandBuffer);
+	if (model.getVertexFormat() == Model::VertexFormat::Packed) {
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Model::Dequantization), &model.getDequantization());
+	}
+}
+
+void RenderManager::updateInstanceGroups(int frameIndex, std::vector<GameObject>& gameObjects) {
+	//the engine clears its objects on shutdown, start over like the scene tree does
+	if (gameObjects.size() < objectGroups.size()) {
+		instanceGroups.clear();
+		groupIndices.clear();
+		drawOrder.clear();
+		objectGroups.clear();
+		instanceCount = 0;
+		groupedObjects = 0;
+		gpuCulling->resizeRecords(0);
+		gpuCulling->markAllRecords();
+	}
+	objectGroups.resize(gameObjects.size(), noGroup);
+	gpuCulling->resizeRecords(static_cast<uint32_t>(gameObjects.size()));
+
+	//the tree only reports plain objects with a model, skybox, terrain and water are drawn on their own below
+	//new ones come with their first transform and join their model's group
+	updated.clear();
+	Engine::sceneTree.takeUpdated(updated);
+	bool grown = false;
+	for (uint32_t object : updated) {
+		if (objectGroups[object] != noGroup) {
+			continue;
+		}
+		Model* model = gameObjects[object].model.get();
+		auto [entry, inserted] = groupIndices.try_emplace(model, static_cast<uint32_t>(instanceGroups.size()));
+		if (inserted) {
+			instanceGroups.push_back({ model, object, 0, 0, 0 });
+		}
+		InstanceGroup& group = instanceGroups[entry->second];
+		if (++group.objectCount > group.capacity) {
+			group.capacity = std::max(64u, group.capacity * 2);
+			grown = true;
+		}
+		objectGroups[object] = entry->second;
+		groupedObjects++;
+	}
+	if (grown) {
+		layoutInstanceGroups();
+	}
+
+	//records of new and moved objects, the others are kept from before, batches run on the thread pool
+	const uint32_t objectsPerJob = 1024;
+	GpuCulling::Record* records = gpuCulling->getRecords();
+	const uint32_t updatedCount = static_cast<uint32_t>(updated.size());
+	ThreadPool::global().parallelFor((updatedCount + objectsPerJob - 1) / objectsPerJob, [&](uint32_t job) {
+		uint32_t end = std::min(updatedCount, (job + 1) * objectsPerJob);
+		for (uint32_t i = job * objectsPerJob; i < end; i++) {
+			uint32_t object = updated[i];
+			GameObject& gameObject = gameObjects[object];
+			GpuCulling::Record& record = records[object];
+			record.model = gameObject.transform.mat4();
+			record.sphere = gameObject.model->getBoundingSphere();
+			record.boundsMin = glm::vec4(gameObject.model->getBoundsMin(), 0.f);
+			record.boundsMax = glm::vec4(gameObject.model->getBoundsMax(), 0.f);
+			record.command = objectGroups[object];
+			record.firstInstance = instanceGroups[objectGroups[object]].firstInstance;
+		}
+	});
+	if (!grown) {
+		gpuCulling->markRecords(updated);
+	}
+
+	//the frame that used these buffers last has finished, so growing them in place is safe
+	//records are copied even with nothing to draw, so the marked ones don't pile up
+	gpuCulling->reserve(frameIndex, instanceCount, static_cast<uint32_t>(instanceGroups.size()));
+	uint32_t* commands = gpuCulling->getCommands(frameIndex);
+	for (uint32_t i = 0; i < instanceGroups.size(); i++) {
+		instanceGroups[i].model->writeIndirectCommand(commands + i * 5);
+	}
+}
+
+void RenderManager::layoutInstanceGroups() {
+	drawOrder.resize(instanceGroups.size());
+	std::iota(drawOrder.begin(), drawOrder.end(), 0u);
+	std::stable_sort(drawOrder.begin(), drawOrder.end(), [&](uint32_t a, uint32_t b) {
+		return instanceGroups[a].model->getVertexFormat() < instanceGroups[b].model->getVertexFormat();
+	});
+
+	instanceCount = 0;
+	for (uint32_t group : drawOrder) {
+		instanceGroups[group].firstInstance = instanceCount;
+		instanceCount += instanceGroups[group].capacity;
+	}
+
+	//only happens when a group fills up, so the full pass stays rare
+	GpuCulling::Record* records = gpuCulling->getRecords();
+	for (uint32_t object = 0; object < objectGroups.size(); object++) {
+		if (objectGroups[object] != noGroup) {
+			records[object].command = objectGroups[object];
+			records[object].firstInstance = instanceGroups[objectGroups[object]].firstInstance;
+		}
+	}
+	gpuCulling->markAllRecords();
+}
+
+void RenderManager::prepare(FrameInfo& frameInfo, std::vector<GameObject>& gameObjects) {
+	//the frame's fence has been waited on, so its last culling pass has written the counters
+	GpuCulling::Counters counters = gpuCulling->collectCounters(frameInfo.frameIndex);
+	cullingStats.gpuTested = counters.tested;
+	cullingStats.frustumCulled = counters.frustumCulled;
+	cullingStats.occlusionCulled = counters.occlusionCulled;
+
+	updateInstanceGroups(frameInfo.frameIndex, gameObjects);
+	cullingStats.objects = groupedObjects;
+
+	//instances are in world space, so the planes come from the plain view projection
+	//occlusion is tested against the depth of the previous frame
+	Constants::Frustum cameraFrustum;
+	cameraFrustum.update(frameInfo.camera.getProjection() * frameInfo.camera.getView());
+	gpuCulling->cull(frameInfo.commandBuffer, frameInfo.frameIndex, static_cast<uint32_t>(instanceGroups.size()), cameraFrustum, *depthPyramid);
+}
+
+void RenderManager::buildDepthPyramid(FrameInfo& frameInfo, VkImageView depthView, VkExtent2D extent) {
+	depthPyramid->build(frameInfo.commandBuffer, frameInfo.frameIndex, depthView, extent, frameInfo.camera.getProjection() * frameInfo.camera.getView());
+}
+
+void RenderManager::renderGameObjects(FrameInfo& frameInfo, std::vector<GameObject>& gameObjects) {
+	VkCommandBuffer commandBuffer = frameInfo.commandBuffer;
+	const Camera& camera = frameInfo.camera;
+	Buffer& uniformBuffer = frameInfo.uniformBuffer;
+
+	//slots for this frame start after the regions of the other frames in flight
+	const uint32_t frameBase = static_cast<uint32_t>(frameInfo.frameIndex * gameObjects.size());
+
 	//TODO: rework multi pipeline system 
 	//cubemap
 	pipelines[0]->bind(commandBuffer);
-	auto it = std::find_if(std::begin(Engine::gameObjects), std::end(Engine::gameObjects), [&](GameObject const& obj) { return obj.getTag() == "skybox"; });
-	auto index = std::distance(Engine::gameObjects.begin(), it);
+	int32_t index = Engine::sceneTree.find(Engine::gameObjects, "skybox");
 	Constants::CubeMapUBO ubo{};
 	ubo.view = glm::mat4(glm::mat3(camera.getView()));  
 	ubo.proj = camera.getProjection();
 
-	void* data;
-	vkMapMemory(device.device(), uniformBuffersMemory[index], 0, sizeof(ubo), 0, &data);
-		memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(device.device(), uniformBuffersMemory[index]);
-
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.object, 0, 1, &DescriptorManager::descriptorSets.objects[index], 0, nullptr);
+	uint32_t dynamicOffset = writeUniform(uniformBuffer, &ubo, sizeof(ubo), frameBase + index);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.object, 0, 1, &DescriptorManager::descriptorSets.objects[index], 1, &dynamicOffset);
 
-	gameObjects.back().model->bind(commandBuffer);
-	gameObjects.back().model->draw(commandBuffer);
+	gameObjects[index].model->bindPositions(commandBuffer);
+	gameObjects[index].model->draw(commandBuffer);
 
 	
-	//game object pipeline
-	pipelines[1]->bind(commandBuffer);
-	//for (auto& obj : gameObjects) {
-	for (int i = 0; i < gameObjects.size(); i++) {
-		if (gameObjects[i].getTag() != "water" && 
-				gameObjects[i].getTag() != "skybox" &&
-				gameObjects[i].getTag() != "terrain") {
-			Constants::ObjectUBO ubo{};
-			ubo.lightPos = Engine::lightPos;
-			ubo.viewPos = camera.getCameraPos();
-			ubo.model = gameObjects[i].transform.mat4();
-			ubo.view = camera.getView();
-			ubo.proj = camera.getProjection();
-
-			void* data;
-			vkMapMemory(device.device(), uniformBuffersMemory[gameObjects[i].getId()], 0, sizeof(ubo), 0, &data);
-			memcpy(data, &ubo, sizeof(ubo));
-			vkUnmapMemory(device.device(), uniformBuffersMemory[gameObjects[i].getId()]);
-
-			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.object, 0, 1, &DescriptorManager::descriptorSets.objects[gameObjects[i].getId()], 0, nullptr);
-
-			gameObjects[i].model->bind(commandBuffer);
-			gameObjects[i].model->draw(commandBuffer);
+	//game objects, one indirect draw per model with the instances that survived culling in prepare
+	Pipeline* boundPipeline = nullptr;
+	VkBuffer instanceBuffer = gpuCulling->getInstanceBuffer(frameInfo.frameIndex);
+	VkBuffer indirectBuffer = gpuCulling->getCommandBuffer(frameInfo.frameIndex);
+	for (uint32_t i : drawOrder) {
+		const InstanceGroup& group = instanceGroups[i];
+		Pipeline* pipeline = group.model->getVertexFormat() == Model::VertexFormat::Packed ? pipelines[4].get() : pipelines[1].get();
+		if (pipeline != boundPipeline) {
+			pipeline->bind(commandBuffer);
+			boundPipeline = pipeline;
 		}
+		//the model matrix comes from the instance stream
+		Constants::ObjectUBO ubo{};
+		ubo.lightPos = Engine::lightPos;
+		ubo.viewPos = camera.getCameraPos();
+		ubo.model = glm::mat4(1.f);
+		ubo.view = camera.getView();
+		ubo.proj = camera.getProjection();
+
+		dynamicOffset = writeUniform(uniformBuffer, &ubo, sizeof(ubo), frameBase + group.object);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.object, 0, 1, &DescriptorManager::descriptorSets.objects[group.object], 1, &dynamicOffset);
+
+		bindModel(commandBuffer, pipelineLayouts.object, *group.model);
+		//binding at the group's range keeps firstInstance zero, which needs no drawIndirectFirstInstance
+		VkDeviceSize instanceOffset = group.firstInstance * sizeof(Model::Instance);
+		vkCmdBindVertexBuffers(commandBuffer, 3, 1, &instanceBuffer, &instanceOffset);
+		group.model->drawIndirect(commandBuffer, indirectBuffer, i * GpuCulling::commandStride);
 	}
 
-	//terrain 
+	//terrain, quadtree nodes selected and culled on the cpu, then tessellated per patch
 	pipelines[3]->bind(commandBuffer);
-	it = std::find_if(std::begin(Engine::gameObjects), std::end(Engine::gameObjects), [&](GameObject const& obj) { return obj.getTag() == "terrain"; });
-	index = std::distance(Engine::gameObjects.begin(), it);
+	index = Engine::sceneTree.find(Engine::gameObjects, "terrain");
 	Constants::TesselationUBO tesselationUBO{};
 	
-	tesselationUBO.displacementFactor = 10;
+	tesselationUBO.displacementFactor = Engine::terrain->getInfo().heightScale;
 	tesselationUBO.tessellatedEdgeSize = 0.1;
 
 	tesselationUBO.projection = camera.getProjection();
@@ -157,38 +350,37 @@ void RenderManager::renderGameObjects(VkCommandBuffer commandBuffer,
 	frustum.update(tesselationUBO.projection * tesselationUBO.modelview);
 	memcpy(tesselationUBO.frustumPlanes, frustum.planes.data(), sizeof(glm::vec4) * 6);
 
-	void* dataTess;
-	vkMapMemory(device.device(), uniformBuffersMemory[gameObjects[index].getId()], 0, sizeof(tesselationUBO), 0, &dataTess);
-	memcpy(dataTess, &tesselationUBO, sizeof(tesselationUBO));
-	vkUnmapMemory(device.device(), uniformBuffersMemory[gameObjects[index].getId()]);
-
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.terrain, 0, 1, &DescriptorManager::descriptorSets.terrain, 0, nullptr);
+	dynamicOffset = writeUniform(uniformBuffer, &tesselationUBO, sizeof(tesselationUBO), frameBase + index);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.terrain, 0, 1, &DescriptorManager::descriptorSets.terrain, 1, &dynamicOffset);
 
-	gameObjects[index].model->bind(commandBuffer);
-	gameObjects[index].model->draw(commandBuffer);
+	//nodes live in the terrain object's space like the water rings
+	glm::vec3 terrainCameraPos = glm::vec3(glm::inverse(gameObjects[index].transform.mat4()) * glm::vec4(camera.getCameraPos(), 1.f));
+	float screenFactor = 0.5f * static_cast<float>(Settings::height) * std::abs(tesselationUBO.projection[1][1]);
+	Engine::terrain->update(terrainCameraPos, frustum, screenFactor);
+	Engine::terrain->draw(commandBuffer, pipelineLayouts.terrain);
 
-	//water 
+	//water, clipmap rings around the camera culled per chunk
 	pipelines[2]->bind(commandBuffer);
-	it = std::find_if(std::begin(Engine::gameObjects), std::end(Engine::gameObjects), [&](GameObject const& obj) { return obj.getTag() == "water"; });
-	index = std::distance(Engine::gameObjects.begin(), it);
+	index = Engine::sceneTree.find(Engine::gameObjects, "water");
 	Constants::ObjectUBO waterubo{};
 	waterubo.lightPos = Engine::lightPos;
 	waterubo.viewPos = camera.getCameraPos();
 	waterubo.model = gameObjects[index].transform.mat4();
 	waterubo.view = camera.getView();
 	waterubo.proj = camera.getProjection();
-	waterubo.time = glfwGetTime();
+	waterubo.time = Window::getTime();
 
-	void* dataWater;
-	vkMapMemory(device.device(), uniformBuffersMemory[gameObjects[index].getId()], 0, sizeof(waterubo), 0, &dataWater);
-	memcpy(dataWater, &waterubo, sizeof(waterubo));
-	vkUnmapMemory(device.device(), uniformBuffersMemory[gameObjects[index].getId()]);
+	dynamicOffset = writeUniform(uniformBuffer, &waterubo, sizeof(waterubo), frameBase + index);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.water, 0, 1, &DescriptorManager::descriptorSets.objects[index], 1, &dynamicOffset);
+	VkDescriptorSet waveSet = Engine::waves->getDescriptorSet(frameInfo.frameIndex);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.water, 1, 1, &waveSet, 0, nullptr);
 
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.object, 0, 1, &DescriptorManager::descriptorSets.objects[gameObjects[index].getId()], 0, nullptr);
-
-	gameObjects[index].model->bind(commandBuffer);
-	gameObjects[index].model->draw(commandBuffer);
+	//the rings live in the water object's space, so cull and recenter there
+	Constants::Frustum waterFrustum;
+	waterFrustum.update(waterubo.proj * waterubo.view * waterubo.model);
+	glm::vec3 localCameraPos = glm::vec3(glm::inverse(waterubo.model) * glm::vec4(camera.getCameraPos(), 1.f));
+	Engine::water->update(localCameraPos, waterFrustum, Engine::waves->getMaxDisplacement());
+	Engine::water->draw(commandBuffer, pipelineLayouts.water);
 
 
 }
-
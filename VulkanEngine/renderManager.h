@@ -3,6 +3,7 @@
 #include <memory>
 #include <array>
 #include <vector>
+#include <unordered_map>
 
 #include "window.h"
 #include "pipeline.h"
@@ -11,30 +12,88 @@
 #include "camera.h"
 #include "texture.h"
 #include "constants.h"
+#include "buffer.h"
+#include "frameInfo.h"
+#include "waterSurface.h"
+#include "terrain.h"
+#include "swapchain.h"
+#include "gpuCulling.h"
+#include "depthPyramid.h"
 
 
 class RenderManager {
 public:
-	RenderManager(Device& device, VkRenderPass renderPass);
+	//the renderer is only handed on to the depth pyramid for its deferred destroys
+	RenderManager(Device& device, Renderer& renderer, VkRenderPass renderPass);
 	~RenderManager();
 
 	//delete copy constructors
 	RenderManager(const RenderManager&) = delete;
 	RenderManager& operator=(const RenderManager&) = delete;
 
-	void renderGameObjects(VkCommandBuffer commandBuffer, std::vector<GameObject>& gameObjects, const Camera& camera, std::vector<VkDeviceMemory> uniformBufferMemory);
+	//objects tested and rejected per frame, the gpu counts come from the frame that last used this frame index
+	struct CullingStats {
+		uint32_t objects = 0; //drawn instanced, each one is tested by the gpu pass
+		uint32_t gpuTested = 0;
+		uint32_t frustumCulled = 0;
+		uint32_t occlusionCulled = 0;
+	};
+
+	//groups the game objects by model and culls them on the gpu, has to be recorded outside of the render pass
+	void prepare(FrameInfo& frameInfo, std::vector<GameObject>& gameObjects);
+	void renderGameObjects(FrameInfo& frameInfo, std::vector<GameObject>& gameObjects);
+	//reduces the frame's depth for the next frame's occlusion test, recorded after the render pass
+	void buildDepthPyramid(FrameInfo& frameInfo, VkImageView depthView, VkExtent2D extent);
+
+	const CullingStats& getCullingStats() const { return cullingStats; }
 
 private:
 	Device& device;
-	std::array<std::unique_ptr<Pipeline>, 4> pipelines;
+	std::array<std::unique_ptr<Pipeline>, 5> pipelines;
 	struct {
 		VkPipelineLayout object;
 		VkPipelineLayout terrain;
+		VkPipelineLayout water;
 	} pipelineLayouts;
 
 	Constants::Frustum frustum;
 
+	//objects sharing a model, drawn with one indirect call whose instance count the culling pass fills in
+	//kept between frames and indexed like the indirect commands, objects only ever join a group
+	struct InstanceGroup {
+		Model* model;
+		uint32_t object; //its descriptor set and uniform slot serve the whole group
+		uint32_t firstInstance;
+		uint32_t objectCount; //the upper bound of the visible ones
+		uint32_t capacity; //size of its instance range, doubles when full so the ranges rarely move
+	};
+	static constexpr uint32_t noGroup = 0xffffffff;
+	std::vector<InstanceGroup> instanceGroups;
+	std::unordered_map<Model*, uint32_t> groupIndices;
+	//packed and full models alternate pipelines, drawing them sorted keeps it to one switch
+	std::vector<uint32_t> drawOrder;
+	//group of every game object, noGroup for the ones drawn on their own
+	std::vector<uint32_t> objectGroups;
+	uint32_t instanceCount = 0;
+	uint32_t groupedObjects = 0;
+	std::unique_ptr<GpuCulling> gpuCulling;
+	std::unique_ptr<DepthPyramid> depthPyramid;
+	CullingStats cullingStats;
+
+	//objects the scene tree has picked up as new or moved since the last frame, kept between frames to skip the allocation
+	std::vector<uint32_t> updated;
+
 	void createPipelineLayout();
 	void createPipeline(VkRenderPass renderPass);
+
+	//copies into a ring slot and returns the dynamic offset to bind it with
+	uint32_t writeUniform(Buffer& uniformBuffer, void* data, VkDeviceSize size, uint32_t slot);
+	//binds the model's buffers, packed models also push their dequantization constants
+	void bindModel(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, Model& model);
+	//adds new objects to their model's group and rewrites the records of new and moved ones
+	//nothing here visits objects that didn't change, the gpu pass culls all of them
+	void updateInstanceGroups(int frameIndex, std::vector<GameObject>& gameObjects);
+	//places the instance ranges after a group has grown and points every grouped record at its group again
+	void layoutInstanceGroups();
 };
 
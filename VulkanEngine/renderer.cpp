@@ -3,6 +3,7 @@
 #include <stdexcept>
 #include <iostream>
 #include <thread>
+#include <algorithm>
 
 #include "spdlog/spdlog.h"
 
@@ -17,6 +18,7 @@ Renderer::Renderer(Window& window, Device& device) : window(window), device(devi
 }
 
 Renderer::~Renderer() {
+	flushPendingDestroys();
 	freeCommandBuffers();
 }
 
@@ -30,6 +32,9 @@ VkCommandBuffer Renderer::beginFrame() {
 	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
+
+	//acquire waited on this frame's fence, so one more frame in flight has retired
+	collectPendingDestroys();
 	
 	isFrameStarted = true;
 	auto commandBuffer = getCurrentCommandBuffer();
@@ -98,6 +103,29 @@ void Renderer::endSwapChainRenderPass(VkCommandBuffer commandBuffer) {
 
 
 
+void Renderer::deferDestroy(std::function<void()> deleter) {
+	pendingDestroys.push_back({ std::move(deleter), Swapchain::MAX_FRAMES_IN_FLIGHT });
+}
+
+void Renderer::flushPendingDestroys() {
+	vkDeviceWaitIdle(device.device());
+	for (auto& pending : pendingDestroys) {
+		pending.deleter();
+	}
+	pendingDestroys.clear();
+}
+
+void Renderer::collectPendingDestroys() {
+	for (auto& pending : pendingDestroys) {
+		if (--pending.framesLeft == 0) {
+			pending.deleter();
+		}
+	}
+	pendingDestroys.erase(
+		std::remove_if(pendingDestroys.begin(), pendingDestroys.end(), [](const PendingDestroy& pending) { return pending.framesLeft <= 0; }),
+		pendingDestroys.end());
+}
+
 void Renderer::createCommandBuffers() {
 	commandBuffers.resize(Swapchain::MAX_FRAMES_IN_FLIGHT);
 
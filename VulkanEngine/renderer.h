@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <vector>
+#include <functional>
 
 #include "window.h"
 #include "pipeline.h"
@@ -25,10 +26,18 @@ public:
 	void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
 	void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
+	//runs deleter once no frame in flight can still be using the resource
+	void deferDestroy(std::function<void()> deleter);
+	//waits for the device and runs every deferred deleter now, for when what they free goes away before the renderer
+	void flushPendingDestroys();
+
 	//getters
 	VkRenderPass getSwapChainRenderPass() const { return swapchain->getRenderPass(); }
 	bool isFrameInProgress() const { return isFrameStarted; }
 	VkImage getCurrentImage() { return swapchain->getSwapChainImages()[currentImageIndex]; }
+	VkImageView getCurrentDepthImageView() { return swapchain->getDepthImageView(currentImageIndex); }
+	VkExtent2D getSwapChainExtent() const { return swapchain->getSwapChainExtent(); }
+	VkImageLayout getFinalLayout() const { return swapchain->getFinalLayout(); }
 	VkCommandBuffer getCurrentCommandBuffer() const {
 		return commandBuffers[currentFrameIndex];
 	}
@@ -52,6 +61,14 @@ private:
 	int currentFrameIndex{ 0 };
 	bool isFrameStarted{ false };
 
+	struct PendingDestroy {
+		std::function<void()> deleter;
+		int framesLeft;
+	};
+	std::vector<PendingDestroy> pendingDestroys;
+
+	void collectPendingDestroys();
+
 	void createCommandBuffers();
 	void freeCommandBuffers();
 	void recreateSwapChain();
@@ -0,0 +1,408 @@
+#include "sceneTree.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "culling.h"
+
+static bool overlaps(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB) {
+	return glm::all(glm::lessThanEqual(minA, maxB)) && glm::all(glm::lessThanEqual(minB, maxA));
+}
+
+static bool overlapsSphere(const glm::vec3& min, const glm::vec3& max, const glm::vec3& center, float radius) {
+	glm::vec3 offset = glm::clamp(center, min, max) - center;
+	return glm::dot(offset, offset) <= radius * radius;
+}
+
+//distance along the ray to where it enters the box, 0 when it starts inside
+static bool intersectRay(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, const glm::vec3& min, const glm::vec3& max, float& distance) {
+	glm::vec3 t1 = (min - origin) * inverseDirection;
+	glm::vec3 t2 = (max - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t1, t2);
+	glm::vec3 tFar = glm::max(t1, t2);
+	float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	if (enter > exit) {
+		return false;
+	}
+	distance = enter;
+	return true;
+}
+
+//surface area of the box, what the insertion cost is measured in
+static float area(const glm::vec3& min, const glm::vec3& max) {
+	glm::vec3 extent = max - min;
+	return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+
+template<typename Visit>
+void SceneTree::traverse(Visit visit) const {
+	if (root == nullNode) {
+		return;
+	}
+	std::vector<int32_t> stack;
+	stack.push_back(root);
+	while (!stack.empty()) {
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+		if (visit(node) && !node.isLeaf()) {
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+void SceneTree::sync(std::vector<GameObject>& gameObjects) {
+	//the engine clears its objects on shutdown, start over if that ever happens earlier
+	if (gameObjects.size() < entries.size()) {
+		nodes.clear();
+		entries.clear();
+		moved.clear();
+		updated.clear();
+		root = nullNode;
+		freeList = nullNode;
+	}
+
+	for (uint32_t i = static_cast<uint32_t>(entries.size()); i < gameObjects.size(); i++) {
+		Entry entry{};
+		entry.spatial = isSpatial(gameObjects[i].getTag());
+		entries.push_back(entry);
+		if (entry.spatial) {
+			updateEntry(i, gameObjects[i]);
+		}
+	}
+
+	for (uint32_t object : moved) {
+		entries[object].queued = false;
+		if (entries[object].spatial) {
+			updateEntry(object, gameObjects[object]);
+		}
+	}
+	moved.clear();
+}
+
+void SceneTree::markMoved(uint32_t object) {
+	//objects the tree hasn't seen yet are inserted with their latest transform anyway
+	if (object < entries.size() && !entries[object].queued) {
+		entries[object].queued = true;
+		moved.push_back(object);
+	}
+}
+
+void SceneTree::takeUpdated(std::vector<uint32_t>& objects) {
+	for (uint32_t object : updated) {
+		entries[object].reported = false;
+	}
+	objects.insert(objects.end(), updated.begin(), updated.end());
+	updated.clear();
+}
+
+int32_t SceneTree::find(const std::vector<GameObject>& gameObjects, const std::string& tag) {
+	if (gameObjects.size() < taggedCount) {
+		tags.clear();
+		taggedCount = 0;
+	}
+	//tags aren't unique, the first object keeps it like a front to back search would
+	for (; taggedCount < gameObjects.size(); taggedCount++) {
+		tags.try_emplace(gameObjects[taggedCount].getTag(), taggedCount);
+	}
+
+	auto it = tags.find(tag);
+	return it == tags.end() ? -1 : static_cast<int32_t>(it->second);
+}
+
+void SceneTree::queryFrustum(const Constants::Frustum& frustum, std::vector<uint32_t>& objects) const {
+	if (root == nullNode) {
+		return;
+	}
+
+	//below a node that is entirely inside, every leaf is taken without further tests
+	std::vector<std::pair<int32_t, bool>> stack;
+	stack.push_back({ root, false });
+	while (!stack.empty()) {
+		auto [index, inside] = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[index];
+
+		if (!inside) {
+			//leaves are tested with the exact box, their enlarged one only decides the descent
+			const Entry* entry = node.isLeaf() ? &entries[node.object] : nullptr;
+			Culling::Containment containment = entry ? Culling::classifyBox(frustum, entry->min, entry->max) : Culling::classifyBox(frustum, node.min, node.max);
+			if (containment == Culling::Containment::Outside) {
+				continue;
+			}
+			inside = containment == Culling::Containment::Inside;
+		}
+
+		if (node.isLeaf()) {
+			objects.push_back(node.object);
+		}
+		else {
+			stack.push_back({ node.child1, inside });
+			stack.push_back({ node.child2, inside });
+		}
+	}
+}
+
+void SceneTree::queryBox(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& objects) const {
+	traverse([&](const Node& node) {
+		if (!overlaps(node.min, node.max, min, max)) {
+			return false;
+		}
+		if (node.isLeaf() && overlaps(entries[node.object].min, entries[node.object].max, min, max)) {
+			objects.push_back(node.object);
+		}
+		return true;
+	});
+}
+
+void SceneTree::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& objects) const {
+	traverse([&](const Node& node) {
+		if (!overlapsSphere(node.min, node.max, center, radius)) {
+			return false;
+		}
+		if (node.isLeaf() && overlapsSphere(entries[node.object].min, entries[node.object].max, center, radius)) {
+			objects.push_back(node.object);
+		}
+		return true;
+	});
+}
+
+bool SceneTree::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const {
+	float length = glm::length(direction);
+	if (length == 0.f) {
+		return false;
+	}
+	//axis parallel rays divide by zero into infinities, which the slab test handles
+	glm::vec3 inverseDirection = length / direction;
+
+	bool found = false;
+	float closest = maxDistance;
+	traverse([&](const Node& node) {
+		//anything entering further than the closest hit so far can't beat it
+		float distance;
+		if (!intersectRay(origin, inverseDirection, closest, node.min, node.max, distance)) {
+			return false;
+		}
+		if (node.isLeaf() && intersectRay(origin, inverseDirection, closest, entries[node.object].min, entries[node.object].max, distance)) {
+			hit = { node.object, distance };
+			closest = distance;
+			found = true;
+		}
+		return true;
+	});
+	return found;
+}
+
+
+void SceneTree::updateEntry(uint32_t object, GameObject& gameObject) {
+	Entry& entry = entries[object];
+	const Model* model = gameObject.model.get();
+	if (!model) {
+		if (entry.leaf != nullNode) {
+			removeLeaf(entry.leaf);
+			freeNode(entry.leaf);
+			entry.leaf = nullNode;
+		}
+		return;
+	}
+	if (!entry.reported) {
+		entry.reported = true;
+		updated.push_back(object);
+	}
+
+	Culling::transformBox(gameObject.transform.mat4(), model->getBoundsMin(), model->getBoundsMax(), entry.min, entry.max);
+	if (entry.leaf != nullNode) {
+		const Node& leaf = nodes[entry.leaf];
+		if (glm::all(glm::greaterThanEqual(entry.min, leaf.min)) && glm::all(glm::lessThanEqual(entry.max, leaf.max))) {
+			return;
+		}
+		removeLeaf(entry.leaf);
+	}
+	else {
+		entry.leaf = allocateNode();
+	}
+
+	//a tenth of the size plus a little, so objects moving a few units a frame stay in their leaf for a while
+	glm::vec3 margin = (entry.max - entry.min) * 0.1f + glm::vec3(0.1f);
+	Node& leaf = nodes[entry.leaf];
+	leaf.min = entry.min - margin;
+	leaf.max = entry.max + margin;
+	leaf.object = object;
+	leaf.child1 = nullNode;
+	leaf.child2 = nullNode;
+	leaf.height = 0;
+	insertLeaf(entry.leaf);
+}
+
+int32_t SceneTree::allocateNode() {
+	if (freeList == nullNode) {
+		nodes.push_back({});
+		freeList = static_cast<int32_t>(nodes.size() - 1);
+		nodes[freeList].parent = nullNode;
+	}
+	int32_t node = freeList;
+	freeList = nodes[node].parent;
+	nodes[node].parent = nullNode;
+	nodes[node].child1 = nullNode;
+	nodes[node].child2 = nullNode;
+	nodes[node].height = 0;
+	return node;
+}
+
+void SceneTree::freeNode(int32_t node) {
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+void SceneTree::insertLeaf(int32_t leaf) {
+	if (root == nullNode) {
+		root = leaf;
+		nodes[root].parent = nullNode;
+		return;
+	}
+
+	//descends towards the sibling that grows the total surface area the least
+	const glm::vec3 leafMin = nodes[leaf].min;
+	const glm::vec3 leafMax = nodes[leaf].max;
+	int32_t index = root;
+	while (!nodes[index].isLeaf()) {
+		const Node& node = nodes[index];
+		float combinedArea = area(glm::min(node.min, leafMin), glm::max(node.max, leafMax));
+		//pairing with this node directly, or the growth every ancestor pays when going further down
+		float cost = 2.f * combinedArea;
+		float inheritanceCost = 2.f * (combinedArea - area(node.min, node.max));
+
+		auto childCost = [&](int32_t child) {
+			const Node& childNode = nodes[child];
+			float grownArea = area(glm::min(childNode.min, leafMin), glm::max(childNode.max, leafMax));
+			return (childNode.isLeaf() ? grownArea : grownArea - area(childNode.min, childNode.max)) + inheritanceCost;
+		};
+		float cost1 = childCost(node.child1);
+		float cost2 = childCost(node.child2);
+
+		if (cost < cost1 && cost < cost2) {
+			break;
+		}
+		index = cost1 < cost2 ? node.child1 : node.child2;
+	}
+
+	int32_t sibling = index;
+	int32_t oldParent = nodes[sibling].parent;
+	int32_t newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].min = glm::min(nodes[sibling].min, leafMin);
+	nodes[newParent].max = glm::max(nodes[sibling].max, leafMax);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == nullNode) {
+		root = newParent;
+	}
+	else if (nodes[oldParent].child1 == sibling) {
+		nodes[oldParent].child1 = newParent;
+	}
+	else {
+		nodes[oldParent].child2 = newParent;
+	}
+
+	refit(nodes[leaf].parent);
+}
+
+void SceneTree::removeLeaf(int32_t leaf) {
+	if (leaf == root) {
+		root = nullNode;
+		return;
+	}
+
+	//the sibling takes the parent's place
+	int32_t parent = nodes[leaf].parent;
+	int32_t grandParent = nodes[parent].parent;
+	int32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+	freeNode(parent);
+
+	nodes[sibling].parent = grandParent;
+	if (grandParent == nullNode) {
+		root = sibling;
+		return;
+	}
+	if (nodes[grandParent].child1 == parent) {
+		nodes[grandParent].child1 = sibling;
+	}
+	else {
+		nodes[grandParent].child2 = sibling;
+	}
+	refit(grandParent);
+}
+
+void SceneTree::refit(int32_t node) {
+	while (node != nullNode) {
+		node = balance(node);
+		Node& current = nodes[node];
+		const Node& child1 = nodes[current.child1];
+		const Node& child2 = nodes[current.child2];
+		current.height = 1 + std::max(child1.height, child2.height);
+		current.min = glm::min(child1.min, child2.min);
+		current.max = glm::max(child1.max, child2.max);
+		node = current.parent;
+	}
+}
+
+int32_t SceneTree::balance(int32_t a) {
+	Node& nodeA = nodes[a];
+	if (nodeA.isLeaf() || nodeA.height < 2) {
+		return a;
+	}
+
+	//the deeper child is rotated up into a's place and a takes the shallower grandchild
+	int32_t b = nodeA.child1;
+	int32_t c = nodeA.child2;
+	int32_t difference = nodes[c].height - nodes[b].height;
+	if (difference >= -1 && difference <= 1) {
+		return a;
+	}
+
+	int32_t up = difference > 1 ? c : b;
+	int32_t other = difference > 1 ? b : c;
+	Node& nodeUp = nodes[up];
+	int32_t grandChild1 = nodeUp.child1;
+	int32_t grandChild2 = nodeUp.child2;
+	//the taller grandchild stays with the rotated node
+	int32_t kept = nodes[grandChild1].height > nodes[grandChild2].height ? grandChild1 : grandChild2;
+	int32_t moved = kept == grandChild1 ? grandChild2 : grandChild1;
+
+	nodeUp.child1 = a;
+	nodeUp.child2 = kept;
+	nodeUp.parent = nodeA.parent;
+	nodeA.parent = up;
+	if (nodeUp.parent == nullNode) {
+		root = up;
+	}
+	else if (nodes[nodeUp.parent].child1 == a) {
+		nodes[nodeUp.parent].child1 = up;
+	}
+	else {
+		nodes[nodeUp.parent].child2 = up;
+	}
+
+	nodeA.child1 = other;
+	nodeA.child2 = moved;
+	nodes[moved].parent = a;
+
+	const Node& nodeOther = nodes[other];
+	const Node& nodeMoved = nodes[moved];
+	nodeA.min = glm::min(nodeOther.min, nodeMoved.min);
+	nodeA.max = glm::max(nodeOther.max, nodeMoved.max);
+	nodeA.height = 1 + std::max(nodeOther.height, nodeMoved.height);
+
+	const Node& nodeKept = nodes[kept];
+	nodeUp.min = glm::min(nodeA.min, nodeKept.min);
+	nodeUp.max = glm::max(nodeA.max, nodeKept.max);
+	nodeUp.height = 1 + std::max(nodeA.height, nodeKept.height);
+	return up;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "glm/glm.hpp"
+
+#include "constants.h"
+#include "gameObject.h"
+
+//dynamic bounding volume hierarchy over the world space boxes of the game objects
+//leaves hold a box a little larger than the object, so small moves don't touch the tree at all
+//an object leaving its box is taken out and reinserted, only the boxes along its path are refit
+//objects are referred to by their index in Engine::gameObjects, which only ever grows
+class SceneTree {
+public:
+	struct RayHit {
+		uint32_t object;
+		float distance; //along the direction, 0 when the origin is inside the object's box
+	};
+
+	SceneTree() = default;
+
+	//delete copy constructors
+	SceneTree(const SceneTree&) = delete;
+	SceneTree& operator=(const SceneTree&) = delete;
+
+	//skybox, terrain and water are drawn from their own data rather than the model's bounds
+	//the skybox surrounds everything, terrain heights are displaced on the gpu and the water rings follow the camera
+	static bool isSpatial(const std::string& tag) { return tag != "skybox" && tag != "terrain" && tag != "water"; }
+
+	//inserts objects added since the last call and moves the ones marked since, nothing else is visited
+	void sync(std::vector<GameObject>& gameObjects);
+	//has to follow every write to an object's transform, queues it for the next sync
+	void markMoved(uint32_t object);
+	//appends the objects with a model whose world transform sync has picked up since the last call
+	//new ones included, so anything derived from the transforms is only recomputed for these
+	void takeUpdated(std::vector<uint32_t>& objects);
+
+	//index of the first object with the tag or -1, picks up objects added since the last lookup
+	int32_t find(const std::vector<GameObject>& gameObjects, const std::string& tag);
+
+	//objects whose boxes overlap, in no particular order, results are appended
+	void queryFrustum(const Constants::Frustum& frustum, std::vector<uint32_t>& objects) const;
+	void queryBox(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& objects) const;
+	void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& objects) const;
+	//closest object box along the ray within maxDistance, direction doesn't have to be normalized
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+
+	uint32_t getHeight() const { return root == nullNode ? 0 : static_cast<uint32_t>(nodes[root].height); }
+
+private:
+	static constexpr int32_t nullNode = -1;
+
+	struct Node {
+		glm::vec3 min;
+		glm::vec3 max;
+		int32_t parent; //next free node while on the free list
+		int32_t child1;
+		int32_t child2;
+		int32_t height; //0 for leaves, -1 while free
+		uint32_t object;
+
+		bool isLeaf() const { return child1 == nullNode; }
+	};
+
+	//what the tree last saw of a game object
+	struct Entry {
+		int32_t leaf = nullNode;
+		glm::vec3 min{}; //exact world box, leaves hold it enlarged
+		glm::vec3 max{};
+		bool spatial = true;
+		bool queued = false; //in moved already
+		bool reported = false; //in updated already
+	};
+
+	std::vector<Node> nodes;
+	int32_t root = nullNode;
+	int32_t freeList = nullNode;
+	std::vector<Entry> entries;
+	std::vector<uint32_t> moved;
+	std::vector<uint32_t> updated;
+
+	std::unordered_map<std::string, uint32_t> tags;
+	uint32_t taggedCount = 0;
+
+	//computes the entry's exact box and moves its leaf when it has left the enlarged one
+	void updateEntry(uint32_t object, GameObject& gameObject);
+
+	int32_t allocateNode();
+	void freeNode(int32_t node);
+	void insertLeaf(int32_t leaf);
+	void removeLeaf(int32_t leaf);
+	//refits the boxes and heights from node up to the root, rotating where a side has grown too deep
+	void refit(int32_t node);
+	int32_t balance(int32_t node);
+	//walks the tree with a stack, visit decides whether to descend and handles leaves
+	template<typename Visit>
+	void traverse(Visit visit) const;
+};
@@ -10,4 +10,9 @@ namespace Settings {
 
 	static inline int width = 800;
 	static inline int height = 600;
+
+	//render offscreen without a window or VK_KHR_swapchain (CI, render farm nodes)
+	static inline bool headless = false;
+	//stop after this many frames, 0 runs until the window is closed
+	static inline int maxFrames = 0;
 }
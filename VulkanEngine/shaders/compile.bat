@@ -8,4 +8,12 @@ C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe tese.tese -o tese.spv
 C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe tesc.tesc -o tesc.spv
 C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe terrainvert.vert -o terrainvert.spv
 C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe terrainfrag.frag -o terrainfrag.spv
+C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe shaderpacked.vert -o vertpacked.spv
+C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe waterpacked.vert -o watervertpacked.spv
+C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe terrainpacked.vert -o terrainvertpacked.spv
+C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe waves.comp -o waves.spv
+C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe terrainnormals.comp -o terrainnormals.spv
+C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe terrainminmax.comp -o terrainminmax.spv
+C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe cull.comp -o cull.spv
+C:/VulkanSDK/1.2.162.1/Bin32/glslc.exe depthpyramid.comp -o depthpyramid.spv
 pause
\ No newline at end of file
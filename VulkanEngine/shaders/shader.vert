@@ -4,6 +4,9 @@ layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
 layout(location = 2) in vec3 inNormal;
 layout(location = 3) in vec2 inTexCoord;
+//per instance, binding 3
+layout(location = 4) in mat4 instanceModel;
+layout(location = 8) in mat3 instanceNormal;
 
 
 layout(location = 0) out vec3 fragPos;
@@ -22,11 +25,11 @@ layout(binding = 0) uniform UniformBufferObject {
 } ubo;
 
 void main() {
-	fragPos = vec3(ubo.model * vec4(position, 1.0));
+	fragPos = vec3(instanceModel * vec4(position, 1.0));
     gl_Position = ubo.proj * ubo.view * vec4(fragPos, 1.0);
 
 	fragTexCoord = inTexCoord;
-	normal = mat3(transpose(inverse(ubo.model))) * inNormal;  
+	normal = instanceNormal * inNormal;  
 	lightPos = ubo.lightPos;
 	viewPos = ubo.viewPos;
 }
\ No newline at end of file
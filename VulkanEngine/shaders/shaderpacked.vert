@@ -0,0 +1,49 @@
+#version 450
+
+layout(location = 0) in vec4 position;
+layout(location = 2) in vec2 inNormal;
+layout(location = 3) in vec2 inTexCoord;
+//per instance, binding 3
+layout(location = 4) in mat4 instanceModel;
+layout(location = 8) in mat3 instanceNormal;
+
+
+layout(location = 0) out vec3 fragPos;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 normal;
+layout(location = 3) out vec3 lightPos;
+layout(location = 4) out vec3 viewPos;
+
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+	vec3 lightPos;
+	vec3 viewPos;
+} ubo;
+
+layout(push_constant) uniform Dequantization {
+	vec4 positionScale;
+	vec4 positionOffset;
+	vec4 texCoordScaleOffset;
+} dequant;
+
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main() {
+	vec3 meshPos = position.xyz * dequant.positionScale.xyz + dequant.positionOffset.xyz;
+	fragPos = vec3(instanceModel * vec4(meshPos, 1.0));
+    gl_Position = ubo.proj * ubo.view * vec4(fragPos, 1.0);
+
+	fragTexCoord = inTexCoord * dequant.texCoordScaleOffset.xy + dequant.texCoordScaleOffset.zw;
+	normal = instanceNormal * octDecode(inNormal);  
+	lightPos = ubo.lightPos;
+	viewPos = ubo.viewPos;
+}
@@ -9,11 +9,11 @@ layout (location = 5) in vec3 inWorldPos;
 
 layout (location = 0) out vec4 outFragColor;
 
-layout(binding = 2) uniform sampler2D texSampler;
+layout(binding = 1) uniform sampler2D texSampler;
 
 vec3 sampleTerrainLayer() {
-	vec3 fragTexCoord = vec3(inUV / 64, 1);
-	vec3 color = texture(texSampler, inUV * 64).rgb;
+	//the height uvs restart every tile, the surface repeats every two units instead
+	vec3 color = texture(texSampler, inWorldPos.xz * 0.5).rgb;
 	return color;
 }
 
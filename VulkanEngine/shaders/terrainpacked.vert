@@ -0,0 +1,23 @@
+#version 450
+
+layout (location = 0) in vec4 inPos;
+
+layout (location = 0) out vec2 outUV;
+
+layout(push_constant) uniform Push {
+	vec4 positionScale;
+	vec4 positionOffset;
+	vec4 texCoordScaleOffset;
+	vec4 rect; //node origin xz, size, patches per side
+	vec4 uvRect; //uv origin and extent in the tile's height texture
+	vec4 neighbours;
+} push;
+
+void main(void)
+{
+	//snap back onto the patch grid so neighbouring nodes share their edge vertices exactly
+	vec2 local = (inPos.xz * push.positionScale.xz + push.positionOffset.xz);
+	local = round(local * push.rect.w) / push.rect.w;
+	gl_Position = vec4(push.rect.x + local.x * push.rect.z, 0.0, push.rect.y + local.y * push.rect.z, 1.0);
+	outUV = push.uvRect.xy + local * push.uvRect.zw;
+}
@@ -0,0 +1,69 @@
+#version 450
+
+layout(location = 0) in vec4 inPosition;
+layout(location = 3) in vec2 inTexCoord;
+
+
+layout(location = 0) out vec3 fragPos;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 normal;
+layout(location = 3) out vec3 lightPos;
+layout(location = 4) out vec3 viewPos;
+
+
+layout(binding = 0) uniform UniformBufferObject {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+	vec3 lightPos;
+	vec3 viewPos;
+	float time;
+} ubo;
+
+//dequantization of the chunk grid followed by the clipmap placement of the chunk
+layout(push_constant) uniform Push {
+	vec4 positionScale;
+	vec4 positionOffset;
+	vec4 texCoordScaleOffset;
+	vec4 chunkOffset;
+	vec4 ring; //center xz, half extent, cell size
+} dequant;
+
+//vertices on the outer edge of a level collapse onto the coarser level's vertices so the rings stay watertight
+vec3 stitch(vec3 p) {
+	vec2 rel = p.xz - dequant.ring.xy;
+	float halfExtent = dequant.ring.z;
+	float coarse = 2.0 * dequant.ring.w;
+	float edge = halfExtent - 0.5 * dequant.ring.w;
+	if (abs(rel.x) >= edge) {
+		rel.y = floor(rel.y / coarse + 0.25) * coarse;
+	}
+	if (abs(rel.y) >= edge) {
+		rel.x = floor(rel.x / coarse + 0.25) * coarse;
+	}
+	return vec3(rel.x + dequant.ring.x, p.y, rel.y + dequant.ring.y);
+}
+
+//filled by waves.comp every frame, the textures tile every params.y units
+layout(set = 1, binding = 0) uniform WaveUBO {
+	vec4 waves[16];
+	vec4 params; //time, tile size, wave count
+} waves;
+layout(set = 1, binding = 3) uniform sampler2D displacementMap;
+layout(set = 1, binding = 4) uniform sampler2D normalMap;
+
+void main() {
+	vec3 position = stitch(inPosition.xyz * dequant.positionScale.xyz + dequant.positionOffset.xyz + dequant.chunkOffset.xyz);
+	fragTexCoord = inTexCoord * dequant.texCoordScaleOffset.xy + dequant.texCoordScaleOffset.zw;
+
+	vec2 waveUV = position.xz / waves.params.y;
+	vec3 pos = position + textureLod(displacementMap, waveUV, 0).xyz;
+	fragPos = vec3(ubo.model * vec4(pos, 1.0));
+    gl_Position = ubo.proj * ubo.view * vec4(fragPos, 1.0);
+
+	vec3 norm = textureLod(normalMap, waveUV, 0).xyz;
+	normal = mat3(transpose(inverse(ubo.model))) * norm;  
+	
+	lightPos = ubo.lightPos;
+	viewPos = ubo.viewPos;
+}
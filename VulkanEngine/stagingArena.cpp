@@ -0,0 +1,75 @@
+#include "stagingArena.h"
+
+#include <algorithm>
+
+StagingArena::StagingArena(Device& device, VkDeviceSize capacity) :
+	buffer{ device,
+		capacity,
+		1,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT },
+	capacity{ capacity } {
+	buffer.map();
+}
+
+bool StagingArena::allocate(VkDeviceSize size, VkDeviceSize alignment, UploadTicket ticket, StagingAllocation& allocation) {
+	if (used == 0) {
+		head = tail = 0;
+	}
+	else if (head == tail) {
+		return false;
+	}
+
+	VkDeviceSize offset = (head + alignment - 1) / alignment * alignment;
+	VkDeviceSize consumed;
+	if (head >= tail) {
+		//free space is [head, capacity) followed by [0, tail)
+		if (offset + size <= capacity) {
+			consumed = offset + size - head;
+		}
+		else if (size <= tail) {
+			offset = 0;
+			consumed = capacity - head + size;
+		}
+		else {
+			return false;
+		}
+	}
+	else if (offset + size <= tail) {
+		consumed = offset + size - head;
+	}
+	else {
+		return false;
+	}
+
+	head = offset + size;
+	used += consumed;
+
+	if (!regions.empty() && regions.back().ticket == ticket) {
+		regions.back().end = head;
+		regions.back().size += consumed;
+	}
+	else {
+		regions.push_back({ ticket, head, consumed });
+	}
+
+	allocation.buffer = buffer.getBuffer();
+	allocation.offset = offset;
+	allocation.mapped = static_cast<char*>(buffer.getMappedMemory()) + offset;
+	return true;
+}
+
+void StagingArena::release(UploadTicket ticket) {
+	auto it = std::find_if(regions.begin(), regions.end(), [&](const Region& region) { return region.ticket == ticket; });
+	if (it == regions.end()) {
+		return;
+	}
+	it->released = true;
+
+	//batches can finish out of order, space only comes back once everything before it is done too
+	while (!regions.empty() && regions.front().released) {
+		tail = regions.front().end;
+		used -= regions.front().size;
+		regions.pop_front();
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <deque>
+
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "buffer.h"
+
+using UploadTicket = uint64_t;
+
+struct StagingAllocation {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	void* mapped = nullptr;
+};
+
+//one persistently mapped host buffer used as a ring, allocations are tagged with the upload batch
+//that reads them and the space is handed back once that batch's fence has signalled
+class StagingArena {
+public:
+	StagingArena(Device& device, VkDeviceSize capacity);
+
+	//delete copy constructors
+	StagingArena(const StagingArena&) = delete;
+	StagingArena& operator=(const StagingArena&) = delete;
+
+	//tickets must not decrease between calls, returns false when the ring has no room
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, UploadTicket ticket, StagingAllocation& allocation);
+	void release(UploadTicket ticket);
+
+	VkDeviceSize getCapacity() const { return capacity; }
+	VkDeviceSize getUsed() const { return used; }
+
+private:
+	struct Region {
+		UploadTicket ticket;
+		VkDeviceSize end;
+		VkDeviceSize size; //includes alignment padding and any bytes skipped when wrapping
+		bool released = false;
+	};
+
+	Buffer buffer;
+	VkDeviceSize capacity;
+	VkDeviceSize head = 0;
+	VkDeviceSize tail = 0;
+	VkDeviceSize used = 0;
+	std::deque<Region> regions;
+};
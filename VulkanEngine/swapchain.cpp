@@ -44,10 +44,13 @@ Swapchain::~Swapchain() {
 		swapChain = nullptr;
 	}
 
+	for (int i = 0; i < colorImageAllocations.size(); i++) {
+		device.destroyImage(swapChainImages[i], colorImageAllocations[i]);
+	}
+
 	for (int i = 0; i < depthImages.size(); i++) {
 		vkDestroyImageView(device.device(), depthImageViews[i], nullptr);
-		vkDestroyImage(device.device(), depthImages[i], nullptr);
-		vkFreeMemory(device.device(), depthImageMemorys[i], nullptr);
+		device.destroyImage(depthImages[i], depthImageAllocations[i]);
 	}
 
 	for (auto framebuffer : swapChainFramebuffers) {
@@ -72,6 +75,12 @@ VkResult Swapchain::acquireNextImage(uint32_t* imageIndex) {
 		VK_TRUE,
 		std::numeric_limits<uint64_t>::max());
 
+	//offscreen images are cycled in lockstep with the frames in flight
+	if (Settings::headless) {
+		*imageIndex = static_cast<uint32_t>(currentFrame);
+		return VK_SUCCESS;
+	}
+
 	VkResult result = vkAcquireNextImageKHR(
 		device.device(),
 		swapChain,
@@ -94,7 +103,7 @@ VkResult Swapchain::submitCommandBuffers(const VkCommandBuffer* buffers, uint32_
 
 	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.waitSemaphoreCount = Settings::headless ? 0 : 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
@@ -102,7 +111,7 @@ VkResult Swapchain::submitCommandBuffers(const VkCommandBuffer* buffers, uint32_
 	submitInfo.pCommandBuffers = buffers;
 
 	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.signalSemaphoreCount = Settings::headless ? 0 : 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
 	vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
@@ -111,6 +120,12 @@ VkResult Swapchain::submitCommandBuffers(const VkCommandBuffer* buffers, uint32_
 		spdlog::critical("Failed to submit draw command buffer");
 	}
 
+	//nothing to present, the in flight fence is all the pacing needed
+	if (Settings::headless) {
+		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		return VK_SUCCESS;
+	}
+
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -131,6 +146,11 @@ VkResult Swapchain::submitCommandBuffers(const VkCommandBuffer* buffers, uint32_
 }
 
 void Swapchain::createSwapChain() {
+	if (Settings::headless) {
+		createOffscreenImages();
+		return;
+	}
+
 	SwapChainSupportDetails swapChainSupport = device.getSwapChainSupport();
 
 	VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -188,6 +208,41 @@ void Swapchain::createSwapChain() {
 	swapChainExtent = extent;
 }
 
+void Swapchain::createOffscreenImages() {
+	swapChainImageFormat = device.findSupportedFormat(
+		{ VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_B8G8R8A8_SRGB },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+	swapChainExtent = windowExtent;
+
+	swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+	colorImageAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+
+	for (int i = 0; i < swapChainImages.size(); i++) {
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = swapChainExtent.width;
+		imageInfo.extent.height = swapChainExtent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = swapChainImageFormat;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.flags = 0;
+
+		device.createImageWithInfo(
+			imageInfo,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			swapChainImages[i],
+			colorImageAllocations[i]);
+	}
+}
+
 void Swapchain::createImageViews() {
 	swapChainImageViews.resize(swapChainImages.size());
 	for (size_t i = 0; i < swapChainImages.size(); i++) {
@@ -214,11 +269,12 @@ void Swapchain::createRenderPass() {
 	depthAttachment.format = findDepthFormat();
 	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	//kept after the pass, the depth pyramid of the occlusion culling is reduced from it
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
 	VkAttachmentReference depthAttachmentRef{};
 	depthAttachmentRef.attachment = 1;
@@ -232,7 +288,7 @@ void Swapchain::createRenderPass() {
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	colorAttachment.finalLayout = getFinalLayout();
 
 	VkAttachmentReference colorAttachmentRef = {};
 	colorAttachmentRef.attachment = 0;
@@ -244,17 +300,26 @@ void Swapchain::createRenderPass() {
 	subpass.pColorAttachments = &colorAttachmentRef;
 	subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.srcAccessMask = 0;
-	dependency.srcStageMask =
+	//the depth pyramid pass of an earlier frame may still be reading the depth image
+	std::array<VkSubpassDependency, 2> dependencies{};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].srcAccessMask = 0;
+	dependencies[0].srcStageMask =
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].dstStageMask =
 		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-	dependency.dstSubpass = 0;
-	dependency.dstStageMask =
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-	dependency.dstAccessMask =
+	dependencies[0].dstAccessMask =
 		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+	//depth writes are visible to the pyramid pass recorded after the render pass
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
 	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -262,8 +327,8 @@ void Swapchain::createRenderPass() {
 	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
 
 	if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
 		spdlog::critical("Failed to create render pass");
@@ -301,7 +366,7 @@ void Swapchain::createDepthResources() {
 	VkExtent2D swapChainExtent = getSwapChainExtent();
 
 	depthImages.resize(imageCount());
-	depthImageMemorys.resize(imageCount());
+	depthImageAllocations.resize(imageCount());
 	depthImageViews.resize(imageCount());
 
 	for (int i = 0; i < depthImages.size(); i++) {
@@ -316,7 +381,7 @@ void Swapchain::createDepthResources() {
 		imageInfo.format = depthFormat;
 		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 		imageInfo.flags = 0;
@@ -325,7 +390,7 @@ void Swapchain::createDepthResources() {
 			imageInfo,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			depthImages[i],
-			depthImageMemorys[i]);
+			depthImageAllocations[i]);
 
 		VkImageViewCreateInfo viewInfo{};
 		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -409,8 +474,9 @@ VkExtent2D Swapchain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilit
 }
 
 VkFormat Swapchain::findDepthFormat() {
+	//the depth pyramid samples the depth buffer
 	return device.findSupportedFormat(
 		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
 		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 }
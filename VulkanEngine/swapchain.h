@@ -25,6 +25,10 @@ public:
 		return static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height);
 	}
 	VkFormat findDepthFormat();
+	//layout the color attachment is left in once the render pass ends
+	VkImageLayout getFinalLayout() const {
+		return Settings::headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	}
 
 	VkResult acquireNextImage(uint32_t *imageIndex);
 	VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
@@ -37,6 +41,8 @@ public:
 	VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
 	VkRenderPass getRenderPass() { return renderPass; }
 	VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+	//depth aspect view, in depth stencil read only layout once the render pass has ended
+	VkImageView getDepthImageView(int index) { return depthImageViews[index]; }
 	size_t imageCount() { return swapChainImages.size(); }
 	VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
 	VkExtent2D getSwapChainExtent() { return swapChainExtent; }
@@ -53,15 +59,16 @@ private:
 	VkRenderPass renderPass;
 
 	std::vector<VkImage> depthImages;
-	std::vector<VkDeviceMemory> depthImageMemorys;
+	std::vector<Allocation> depthImageAllocations;
 	std::vector<VkImageView> depthImageViews;
 	std::vector<VkImage> swapChainImages;
+	std::vector<Allocation> colorImageAllocations; //only owned in headless mode
 	std::vector<VkImageView> swapChainImageViews;
 
 	Device &device;
 	VkExtent2D windowExtent;
 
-	VkSwapchainKHR swapChain;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 	std::shared_ptr<Swapchain> oldSwapchain;
 
 	std::vector<VkSemaphore> imageAvailableSemaphores;
@@ -73,6 +80,7 @@ private:
 
 	void init();
 	void createSwapChain();
+	void createOffscreenImages();
 	void createImageViews();
 	void createDepthResources();
 	void createRenderPass();
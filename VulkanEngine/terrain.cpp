@@ -0,0 +1,923 @@
+#include "terrain.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "spdlog/spdlog.h"
+#include "glm/gtc/packing.hpp"
+
+#include "descriptorManager.h"
+#include "swapchain.h"
+#include "threadPool.h"
+#include "uploadManager.h"
+
+static void replaceAll(std::string& text, const std::string& from, const std::string& to) {
+	for (size_t pos = text.find(from); pos != std::string::npos; pos = text.find(from, pos + to.size())) {
+		text.replace(pos, from.size(), to);
+	}
+}
+
+//min/max height of every node below a tile, nodes share their border texels like they share their edges
+static std::vector<std::vector<glm::vec2>> computeHeightRanges(const Heightfield& heights, uint32_t depth) {
+	const uint32_t width = heights.getWidth();
+	const uint32_t height = heights.getHeight();
+	std::vector<std::vector<glm::vec2>> ranges(depth + 1);
+
+	uint32_t cells = 1u << depth;
+	std::vector<glm::vec2>& finest = ranges[depth];
+	finest.resize(cells * cells);
+	for (uint32_t cz = 0; cz < cells; cz++) {
+		uint32_t z0 = cz * (height - 1) / cells;
+		uint32_t z1 = ((cz + 1) * (height - 1) + cells - 1) / cells;
+		for (uint32_t cx = 0; cx < cells; cx++) {
+			uint32_t x0 = cx * (width - 1) / cells;
+			uint32_t x1 = ((cx + 1) * (width - 1) + cells - 1) / cells;
+			uint16_t low = 65535, high = 0;
+			for (uint32_t z = z0; z <= z1; z++) {
+				const uint16_t* row = heights.data() + static_cast<size_t>(z) * width;
+				for (uint32_t x = x0; x <= x1; x++) {
+					low = std::min(low, row[x]);
+					high = std::max(high, row[x]);
+				}
+			}
+			finest[cz * cells + cx] = glm::vec2(low, high) / 65535.f;
+		}
+	}
+
+	for (int32_t d = static_cast<int32_t>(depth) - 1; d >= 0; d--) {
+		uint32_t n = 1u << d;
+		const std::vector<glm::vec2>& children = ranges[d + 1];
+		ranges[d].resize(n * n);
+		for (uint32_t z = 0; z < n; z++) {
+			for (uint32_t x = 0; x < n; x++) {
+				glm::vec2 range = children[(2 * z) * (2 * n) + 2 * x];
+				for (uint32_t child = 1; child < 4; child++) {
+					glm::vec2 other = children[(2 * z + child / 2) * (2 * n) + 2 * x + child % 2];
+					range = glm::vec2(std::min(range.x, other.x), std::max(range.y, other.y));
+				}
+				ranges[d][z * n + x] = range;
+			}
+		}
+	}
+	return ranges;
+}
+
+Terrain::Terrain(Device& device, Renderer& renderer, std::shared_ptr<Texture> texture, const TerrainInfo& info) : device{ device }, renderer{ renderer }, info{ info } {
+	if (info.tilesX == 0 || info.tilesZ == 0 || info.patchesPerNode == 0) {
+		spdlog::critical("Terrain needs at least one tile and one patch per node");
+		throw std::runtime_error("Terrain");
+	}
+
+	//r16 keeps the full precision, the float formats are the fallback where it can't be filtered
+	heightFormat = device.findSupportedFormat(
+		{ VK_FORMAT_R16_UNORM, VK_FORMAT_R32_SFLOAT, VK_FORMAT_R16_SFLOAT },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+
+	//the root is padded to a power of two tiles, nodes outside the map are skipped
+	uint32_t rootTiles = 1;
+	tileLevel = 0;
+	while (rootTiles < std::max(info.tilesX, info.tilesZ)) {
+		rootTiles *= 2;
+		tileLevel++;
+	}
+	rootSize = rootTiles * info.tileSize;
+	if (tileLevel + info.maxDepth > 28) {
+		spdlog::critical("Terrain quadtree is too deep: {} levels", tileLevel + info.maxDepth);
+		throw std::runtime_error("Terrain");
+	}
+
+	if (info.tilePath.find("{x}") == std::string::npos && info.tilePath.find("{z}") == std::string::npos) {
+		source = std::make_shared<const Heightfield>(Heightfield::load(info.tilePath));
+		if (source->getWidth() <= info.tilesX || source->getHeight() <= info.tilesZ) {
+			spdlog::critical("Terrain heightfield {} is too small for {}x{} tiles", info.tilePath, info.tilesX, info.tilesZ);
+			throw std::runtime_error("Terrain");
+		}
+	}
+
+	tiles.resize(static_cast<size_t>(info.tilesX) * info.tilesZ);
+	if (!source) {
+		tileHeights.resize(tiles.size());
+		tileHeightsUsed = std::vector<std::atomic<uint64_t>>(tiles.size());
+	}
+	createPatchModel(texture);
+	createSampler();
+	createDescriptorPool();
+	createDerivePipelines();
+
+	spdlog::debug("Terrain: {}x{} tiles of {} units, {} quadtree levels, {} resident tiles at most",
+		info.tilesX,
+		info.tilesZ,
+		info.tileSize,
+		tileLevel + info.maxDepth + 1,
+		info.maxResidentTiles);
+}
+
+Terrain::~Terrain() {
+	//loads still running read the source heightfield and the info, let them finish first
+	for (Tile& tile : tiles) {
+		if (tile.pending.valid()) {
+			tile.pending.wait();
+		}
+		if (tile.state == Tile::State::Resident) {
+			destroyTileResources(tile.resources);
+		}
+	}
+	normalPipeline.reset();
+	minMaxPipeline.reset();
+	vkDestroyPipelineLayout(device.device(), derivePipelineLayout, nullptr);
+	for (VkDescriptorPool pool : derivePools) {
+		vkDestroyDescriptorPool(device.device(), pool, nullptr);
+	}
+	vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
+	vkDestroySampler(device.device(), sampler, nullptr);
+}
+
+void Terrain::createPatchModel(std::shared_ptr<Texture> texture) {
+	//unit square of quad patches, the vertex shader scales it onto the node
+	const uint32_t patches = info.patchesPerNode;
+	const uint32_t side = patches + 1;
+	Model::Geometry geometry;
+	geometry.vertices.resize(side * side);
+	for (uint32_t z = 0; z < side; z++) {
+		for (uint32_t x = 0; x < side; x++) {
+			Model::Vertex& vertex = geometry.vertices[z * side + x];
+			vertex.position = glm::vec3(static_cast<float>(x) / patches, 0.f, static_cast<float>(z) / patches);
+			vertex.texCoord = glm::vec2(vertex.position.x, vertex.position.z);
+			vertex.normal = glm::vec3(0.f, -1.f, 0.f);
+			vertex.color = glm::vec3(1.f);
+		}
+	}
+
+	geometry.indices.reserve(patches * patches * 4);
+	for (uint32_t z = 0; z < patches; z++) {
+		for (uint32_t x = 0; x < patches; x++) {
+			uint32_t index = z * side + x;
+			geometry.indices.push_back(index);
+			geometry.indices.push_back(index + side);
+			geometry.indices.push_back(index + side + 1);
+			geometry.indices.push_back(index + 1);
+		}
+	}
+
+	patchModel = std::make_shared<Model>(device, geometry, texture, Model::VertexFormat::Packed);
+}
+
+void Terrain::createSampler() {
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	//tiles repeat their border texels, clamping keeps the neighbour tile out of the filter
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1.f;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+
+	if (vkCreateSampler(device.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+		spdlog::critical("Failed to create terrain sampler");
+		throw std::runtime_error("createSampler");
+	}
+}
+
+void Terrain::createDescriptorPool() {
+	//evicted tiles keep their set until the frames in flight are done with it
+	uint32_t setCount = info.maxResidentTiles + maxUploadsPerFrame * (Swapchain::MAX_FRAMES_IN_FLIGHT + 1);
+
+	//heights, normals and min/max per set
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSize.descriptorCount = setCount * 3;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = setCount;
+
+	if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+		spdlog::critical("Failed to create terrain descriptor pool");
+		throw std::runtime_error("createDescriptorPool");
+	}
+}
+
+void Terrain::createDerivePipelines() {
+	//one normal pass and at most maxMinMaxLevels - 1 reductions per uploaded tile
+	uint32_t setCount = maxUploadsPerFrame * maxMinMaxLevels;
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = setCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = setCount * 2;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = setCount;
+
+	for (VkDescriptorPool& pool : derivePools) {
+		if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+			spdlog::critical("Failed to create terrain derive descriptor pool");
+			throw std::runtime_error("createDerivePipelines");
+		}
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(DerivePush);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &DescriptorManager::descriptorSetLayouts.terrainDerive;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &derivePipelineLayout) != VK_SUCCESS) {
+		spdlog::critical("Failed to create pipeline layout");
+		throw std::runtime_error("createDerivePipelines");
+	}
+
+	normalPipeline = std::make_unique<ComputePipeline>(device, "shaders/terrainnormals.spv", derivePipelineLayout);
+	minMaxPipeline = std::make_unique<ComputePipeline>(device, "shaders/terrainminmax.spv", derivePipelineLayout);
+}
+
+void Terrain::prepare(VkCommandBuffer commandBuffer, int frameIndex) {
+	finishLoads();
+	deriveTiles(commandBuffer, frameIndex);
+}
+
+void Terrain::update(const glm::vec3& cameraPos, Constants::Frustum& frustum, float screenFactor) {
+	frame++;
+	this->cameraPos = cameraPos;
+	this->screenFactor = screenFactor;
+
+	selectedNodes.clear();
+	selectedKeys.clear();
+	selectNode(0, 0, 0, frustum);
+	for (const Node& node : selectedNodes) {
+		selectedKeys.insert(nodeKey(node.level, node.x, node.z));
+	}
+
+	prefetchTiles();
+}
+
+glm::vec2 Terrain::nodeHeightRange(uint32_t level, uint32_t x, uint32_t z) const {
+	if (level < tileLevel) {
+		return glm::vec2(0.f, 1.f);
+	}
+	uint32_t depth = level - tileLevel;
+	const Tile& tile = tiles[(z >> depth) * info.tilesX + (x >> depth)];
+	if (tile.state != Tile::State::Resident) {
+		return glm::vec2(0.f, 1.f);
+	}
+	uint32_t mask = (1u << depth) - 1;
+	return tile.heightRanges[depth][(z & mask) * (1u << depth) + (x & mask)];
+}
+
+void Terrain::selectNode(uint32_t level, uint32_t x, uint32_t z, Constants::Frustum& frustum) {
+	float size = nodeSize(level);
+	glm::vec2 origin = glm::vec2(x, z) * size;
+	if (origin.x >= getExtent().x || origin.y >= getExtent().y) {
+		return;
+	}
+
+	//heights displace towards -y
+	glm::vec2 range = nodeHeightRange(level, x, z);
+	glm::vec3 boundsMin(origin.x, -range.y * info.heightScale, origin.y);
+	glm::vec3 boundsMax(origin.x + size, -range.x * info.heightScale, origin.y + size);
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	if (!frustum.checkSphere(center, glm::length(boundsMax - center))) {
+		return;
+	}
+
+	auto recurse = [&]() {
+		for (uint32_t child = 0; child < 4; child++) {
+			selectNode(level + 1, 2 * x + child % 2, 2 * z + child / 2, frustum);
+		}
+	};
+
+	if (level < tileLevel) {
+		recurse();
+		return;
+	}
+
+	uint32_t depth = level - tileLevel;
+	uint32_t tileIndex = (z >> depth) * info.tilesX + (x >> depth);
+	Tile& tile = tiles[tileIndex];
+	tile.lastUsed = frame;
+	if (tile.state != Tile::State::Resident) {
+		requestTile(tileIndex);
+		return;
+	}
+
+	//projected size of one patch edge, split while it covers too many pixels
+	glm::vec3 closest = glm::clamp(cameraPos, boundsMin, boundsMax);
+	float distance = std::max(glm::length(cameraPos - closest), 1e-3f);
+	float error = size / info.patchesPerNode * screenFactor / distance;
+	if (depth < info.maxDepth && error > info.maxScreenError) {
+		recurse();
+		return;
+	}
+
+	selectedNodes.push_back({ level, x, z, tileIndex });
+}
+
+float Terrain::neighbourRatio(uint32_t level, int32_t x, int32_t z) const {
+	if (x < 0 || z < 0) {
+		return 1.f;
+	}
+	//a selected ancestor of the neighbouring cell means the neighbour is coarser by that many levels
+	for (uint32_t up = 1; up <= level; up++) {
+		if (selectedKeys.count(nodeKey(level - up, static_cast<uint32_t>(x) >> up, static_cast<uint32_t>(z) >> up))) {
+			return static_cast<float>(1u << up);
+		}
+	}
+	return 1.f;
+}
+
+void Terrain::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) {
+	if (selectedNodes.empty()) {
+		return;
+	}
+
+	patchModel->bind(commandBuffer);
+	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Model::Dequantization), &patchModel->getDequantization());
+
+	//selection is depth first, so the nodes of a tile are next to each other
+	uint32_t boundTile = UINT32_MAX;
+	for (const Node& node : selectedNodes) {
+		const Tile& tile = tiles[node.tile];
+		if (node.tile != boundTile) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &tile.resources.descriptorSet, 0, nullptr);
+			boundTile = node.tile;
+		}
+
+		float size = nodeSize(node.level);
+		uint32_t depth = node.level - tileLevel;
+		uint32_t mask = (1u << depth) - 1;
+		glm::vec2 tileFraction = glm::vec2(node.x & mask, node.z & mask) / static_cast<float>(1u << depth);
+		glm::vec2 texels = glm::vec2(tile.width, tile.height);
+
+		//edge texel centers sit exactly on the tile border
+		NodePush push{};
+		push.rect = glm::vec4(node.x * size, node.z * size, size, static_cast<float>(info.patchesPerNode));
+		glm::vec2 uvOrigin = (tileFraction * (texels - 1.f) + 0.5f) / texels;
+		glm::vec2 uvExtent = (texels - 1.f) / (texels * static_cast<float>(1u << depth));
+		push.uvRect = glm::vec4(uvOrigin, uvExtent);
+		int32_t x = static_cast<int32_t>(node.x);
+		int32_t z = static_cast<int32_t>(node.z);
+		push.neighbours = glm::vec4(
+			neighbourRatio(node.level, x - 1, z),
+			neighbourRatio(node.level, x + 1, z),
+			neighbourRatio(node.level, x, z - 1),
+			neighbourRatio(node.level, x, z + 1));
+		vkCmdPushConstants(commandBuffer, pipelineLayout, nodeStages, sizeof(Model::Dequantization), sizeof(NodePush), &push);
+		patchModel->draw(commandBuffer);
+	}
+}
+
+void Terrain::requestTile(uint32_t index) {
+	Tile& tile = tiles[index];
+	if (tile.state != Tile::State::Unloaded || pendingCount >= maxPendingLoads) {
+		return;
+	}
+	uint32_t x = index % info.tilesX;
+	uint32_t z = index / info.tilesX;
+	tile.state = Tile::State::Loading;
+	tile.pending = ThreadPool::global().submit([this, x, z]() { return loadTile(x, z); });
+	pendingCount++;
+}
+
+void Terrain::prefetchTiles() {
+	//tiles around the camera count as used so turning around doesn't evict or wait for them
+	glm::vec2 camera(cameraPos.x, cameraPos.z);
+	glm::ivec2 first = glm::ivec2(glm::floor((camera - info.prefetchDistance) / info.tileSize));
+	glm::ivec2 last = glm::ivec2(glm::floor((camera + info.prefetchDistance) / info.tileSize));
+	first = glm::max(first, glm::ivec2(0));
+	last = glm::min(last, glm::ivec2(info.tilesX, info.tilesZ) - 1);
+	for (int32_t z = first.y; z <= last.y; z++) {
+		for (int32_t x = first.x; x <= last.x; x++) {
+			glm::vec2 tileMin = glm::vec2(x, z) * info.tileSize;
+			glm::vec2 closest = glm::clamp(camera, tileMin, tileMin + info.tileSize);
+			if (glm::length(camera - closest) <= info.prefetchDistance) {
+				uint32_t index = z * info.tilesX + x;
+				tiles[index].lastUsed = frame;
+				requestTile(index);
+			}
+		}
+	}
+}
+
+void Terrain::finishLoads() {
+	//uploads are capped per frame so a burst of finished loads doesn't stall one frame
+	uint32_t uploads = 0;
+	for (Tile& tile : tiles) {
+		if (uploads == maxUploadsPerFrame) {
+			break;
+		}
+		if (tile.state != Tile::State::Loading || tile.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			continue;
+		}
+		if (residentCount >= info.maxResidentTiles) {
+			evictTiles();
+			if (residentCount >= info.maxResidentTiles) {
+				break;
+			}
+		}
+
+		pendingCount--;
+		std::shared_ptr<TileData> data;
+		try {
+			data = tile.pending.get();
+		}
+		catch (const std::exception&) {
+			//already reported by the loader, the tile stays a hole instead of retrying every frame
+			tile.state = Tile::State::Failed;
+			continue;
+		}
+		uploadTile(tile, *data);
+		uploadedTiles.push_back(static_cast<uint32_t>(&tile - tiles.data()));
+		uploads++;
+	}
+
+	if (uploads > 0) {
+		device.uploader().submit();
+	}
+}
+
+void Terrain::uploadTile(Tile& tile, TileData& data) {
+	TileResources& resources = tile.resources;
+	createTileImage(resources.heights, heightFormat, data.width, data.height, 1, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	device.uploader().uploadImage({ data.pixels.data() }, data.pixels.size(), resources.heights.image, data.width, data.height);
+
+	//filled by deriveTiles before anything draws the tile
+	createTileImage(resources.normals, normalFormat, data.width, data.height, 1, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	uint32_t cellsX = data.width - 1;
+	uint32_t cellsZ = data.height - 1;
+	uint32_t levels = 1;
+	while (levels < maxMinMaxLevels && (std::max(cellsX, cellsZ) >> levels) > 0) {
+		levels++;
+	}
+	createTileImage(resources.minMax, minMaxFormat, cellsX, cellsZ, levels, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	resources.minMaxLevels.resize(levels);
+	for (uint32_t level = 0; level < levels; level++) {
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = resources.minMax.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = minMaxFormat;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(device.device(), &viewInfo, nullptr, &resources.minMaxLevels[level]) != VK_SUCCESS) {
+			spdlog::critical("Failed to create terrain min/max level view");
+			throw std::runtime_error("uploadTile");
+		}
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &DescriptorManager::descriptorSetLayouts.terrainTile;
+
+	if (vkAllocateDescriptorSets(device.device(), &allocInfo, &resources.descriptorSet) != VK_SUCCESS) {
+		spdlog::critical("Failed to allocate terrain tile descriptor set");
+		throw std::runtime_error("uploadTile");
+	}
+
+	//the derived images stay in general layout after the compute pass wrote them
+	std::array<VkDescriptorImageInfo, 3> imageInfos{};
+	imageInfos[0] = { sampler, resources.heights.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	imageInfos[1] = { sampler, resources.normals.view, VK_IMAGE_LAYOUT_GENERAL };
+	imageInfos[2] = { sampler, resources.minMax.view, VK_IMAGE_LAYOUT_GENERAL };
+
+	std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+	for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+		descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[binding].dstSet = resources.descriptorSet;
+		descriptorWrites[binding].dstBinding = binding;
+		descriptorWrites[binding].dstArrayElement = 0;
+		descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrites[binding].descriptorCount = 1;
+		descriptorWrites[binding].pImageInfo = &imageInfos[binding];
+	}
+	vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+	tile.width = data.width;
+	tile.height = data.height;
+	tile.heightRanges = std::move(data.heightRanges);
+	tile.state = Tile::State::Resident;
+	residentCount++;
+}
+
+void Terrain::createTileImage(TileImage& tileImage, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageUsageFlags usage) {
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = width;
+	imageInfo.extent.height = height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = format;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = usage;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tileImage.image, tileImage.allocation);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = tileImage.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(device.device(), &viewInfo, nullptr, &tileImage.view) != VK_SUCCESS) {
+		spdlog::critical("Failed to create terrain tile image view");
+		throw std::runtime_error("createTileImage");
+	}
+}
+
+void Terrain::deriveTiles(VkCommandBuffer commandBuffer, int frameIndex) {
+	//the frame that last used this pool has finished, its sets can go
+	vkResetDescriptorPool(device.device(), derivePools[frameIndex], 0);
+
+	//a tile evicted again in the same finishLoads never draws, its resources are already retired
+	std::vector<Tile*> derived;
+	for (uint32_t index : uploadedTiles) {
+		if (tiles[index].state == Tile::State::Resident) {
+			derived.push_back(&tiles[index]);
+		}
+	}
+	uploadedTiles.clear();
+	if (derived.empty()) {
+		return;
+	}
+
+	std::vector<VkImageMemoryBarrier> barriers;
+	for (Tile* tile : derived) {
+		for (VkImage image : { tile->resources.normals.image, tile->resources.minMax.image }) {
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.image = image;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+			barrier.subresourceRange.layerCount = 1;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barriers.push_back(barrier);
+		}
+	}
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data());
+
+	//each level of the min/max chain reads the one before it
+	VkMemoryBarrier levelBarrier{};
+	levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	//normals and the finest min/max level both come straight from the heights
+	normalPipeline->bind(commandBuffer);
+	uint32_t levels = 0;
+	for (Tile* tile : derived) {
+		TileResources& resources = tile->resources;
+		VkDescriptorSet set = allocateDeriveSet(frameIndex, resources.heights.view, resources.normals.view, resources.minMaxLevels[0]);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, derivePipelineLayout, 0, 1, &set, 0, nullptr);
+
+		DerivePush push{};
+		push.heightScale = info.heightScale;
+		push.worldPerTexel = info.tileSize / static_cast<float>(tile->width - 1);
+		vkCmdPushConstants(commandBuffer, derivePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DerivePush), &push);
+		vkCmdDispatch(commandBuffer, (tile->width + 7) / 8, (tile->height + 7) / 8, 1);
+		levels = std::max(levels, static_cast<uint32_t>(resources.minMaxLevels.size()));
+	}
+
+	minMaxPipeline->bind(commandBuffer);
+	for (uint32_t level = 1; level < levels; level++) {
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+		for (Tile* tile : derived) {
+			TileResources& resources = tile->resources;
+			if (level >= resources.minMaxLevels.size()) {
+				continue;
+			}
+			VkDescriptorSet set = allocateDeriveSet(frameIndex, resources.heights.view, resources.minMaxLevels[level - 1], resources.minMaxLevels[level]);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, derivePipelineLayout, 0, 1, &set, 0, nullptr);
+			uint32_t width = std::max(1u, (tile->width - 1) >> level);
+			uint32_t height = std::max(1u, (tile->height - 1) >> level);
+			vkCmdDispatch(commandBuffer, (width + 7) / 8, (height + 7) / 8, 1);
+		}
+	}
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT,
+		0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+}
+
+VkDescriptorSet Terrain::allocateDeriveSet(int frameIndex, VkImageView heights, VkImageView first, VkImageView second) {
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = derivePools[frameIndex];
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &DescriptorManager::descriptorSetLayouts.terrainDerive;
+
+	VkDescriptorSet set;
+	if (vkAllocateDescriptorSets(device.device(), &allocInfo, &set) != VK_SUCCESS) {
+		spdlog::critical("Failed to allocate terrain derive descriptor set");
+		throw std::runtime_error("allocateDeriveSet");
+	}
+
+	std::array<VkDescriptorImageInfo, 3> imageInfos{};
+	imageInfos[0] = { sampler, heights, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	imageInfos[1] = { VK_NULL_HANDLE, first, VK_IMAGE_LAYOUT_GENERAL };
+	imageInfos[2] = { VK_NULL_HANDLE, second, VK_IMAGE_LAYOUT_GENERAL };
+
+	std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+	for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+		descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[binding].dstSet = set;
+		descriptorWrites[binding].dstBinding = binding;
+		descriptorWrites[binding].dstArrayElement = 0;
+		descriptorWrites[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorWrites[binding].descriptorCount = 1;
+		descriptorWrites[binding].pImageInfo = &imageInfos[binding];
+	}
+	vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	return set;
+}
+
+void Terrain::evictTiles() {
+	//least recently used first, tiles selected this frame are never evicted
+	while (residentCount >= info.maxResidentTiles) {
+		Tile* oldest = nullptr;
+		for (Tile& tile : tiles) {
+			if (tile.state == Tile::State::Resident && tile.lastUsed < frame && (!oldest || tile.lastUsed < oldest->lastUsed)) {
+				oldest = &tile;
+			}
+		}
+		if (!oldest) {
+			return;
+		}
+
+		//no frame in flight may still sample the tile once the deleter runs, Engine flushes them before the terrain goes
+		renderer.deferDestroy([this, resources = std::move(oldest->resources)]() mutable { destroyTileResources(resources); });
+		oldest->resources = {};
+		oldest->heightRanges.clear();
+		oldest->state = Tile::State::Unloaded;
+		residentCount--;
+	}
+}
+
+void Terrain::destroyTileResources(TileResources& resources) {
+	vkFreeDescriptorSets(device.device(), descriptorPool, 1, &resources.descriptorSet);
+	for (VkImageView view : resources.minMaxLevels) {
+		vkDestroyImageView(device.device(), view, nullptr);
+	}
+	for (TileImage* tileImage : { &resources.heights, &resources.normals, &resources.minMax }) {
+		vkDestroyImageView(device.device(), tileImage->view, nullptr);
+		device.destroyImage(tileImage->image, tileImage->allocation);
+	}
+}
+
+std::shared_ptr<Terrain::TileData> Terrain::loadTile(uint32_t x, uint32_t z) const {
+	auto data = std::make_shared<TileData>();
+	std::shared_ptr<const Heightfield> heights;
+	if (source) {
+		//neighbouring tiles share their border row and column, the last ones clamp to the source
+		uint32_t tileWidth = (source->getWidth() - 1) / info.tilesX;
+		uint32_t tileHeight = (source->getHeight() - 1) / info.tilesZ;
+		heights = std::make_shared<const Heightfield>(source->region(x * tileWidth, z * tileHeight, tileWidth + 1, tileHeight + 1));
+	}
+	else {
+		heights = getTileHeights(glm::uvec2(x, z));
+	}
+
+	data->width = heights->getWidth();
+	data->height = heights->getHeight();
+	if (data->width < 2 || data->height < 2) {
+		spdlog::critical("Terrain tile {}, {} needs at least 2x2 heights, got {}x{}", x, z, data->width, data->height);
+		throw std::runtime_error("loadTile");
+	}
+	data->heightRanges = computeHeightRanges(*heights, info.maxDepth);
+
+	const uint16_t* samples = heights->data();
+	size_t count = static_cast<size_t>(data->width) * data->height;
+	switch (heightFormat) {
+	case VK_FORMAT_R32_SFLOAT: {
+		data->pixels.resize(count * sizeof(float));
+		float* out = reinterpret_cast<float*>(data->pixels.data());
+		for (size_t i = 0; i < count; i++) {
+			out[i] = samples[i] / 65535.f;
+		}
+		break;
+	}
+	case VK_FORMAT_R16_SFLOAT: {
+		data->pixels.resize(count * sizeof(uint16_t));
+		uint16_t* out = reinterpret_cast<uint16_t*>(data->pixels.data());
+		for (size_t i = 0; i < count; i++) {
+			out[i] = glm::packHalf1x16(samples[i] / 65535.f);
+		}
+		break;
+	}
+	default:
+		data->pixels.resize(count * sizeof(uint16_t));
+		memcpy(data->pixels.data(), samples, data->pixels.size());
+		break;
+	}
+	return data;
+}
+
+glm::uvec2 Terrain::queryTile(const glm::vec2& position) const {
+	if (source) {
+		return glm::uvec2(0);
+	}
+	glm::vec2 tile = glm::floor(position / info.tileSize);
+	return glm::uvec2(glm::clamp(tile, glm::vec2(0.f), glm::vec2(info.tilesX - 1, info.tilesZ - 1)));
+}
+
+std::shared_ptr<const Heightfield> Terrain::getTileHeights(const glm::uvec2& tile) const {
+	if (source) {
+		return source;
+	}
+
+	size_t index = static_cast<size_t>(tile.y) * info.tilesX + tile.x;
+	{
+		std::shared_lock<std::shared_mutex> lock(tileHeightsMutex);
+		if (tileHeights[index]) {
+			tileHeightsUsed[index].store(++tileHeightsClock, std::memory_order_relaxed);
+			return tileHeights[index];
+		}
+	}
+
+	//two threads may both load a missing tile, the first one to finish is kept
+	std::string path = info.tilePath;
+	replaceAll(path, "{x}", std::to_string(tile.x));
+	replaceAll(path, "{z}", std::to_string(tile.y));
+	auto heights = std::make_shared<const Heightfield>(Heightfield::load(path));
+
+	std::unique_lock<std::shared_mutex> lock(tileHeightsMutex);
+	if (!tileHeights[index]) {
+		//queries hold their own reference, so dropping a field one of them still reads is safe
+		if (cachedTileHeights >= info.maxResidentTiles + maxPendingLoads) {
+			size_t oldest = index;
+			for (size_t i = 0; i < tileHeights.size(); i++) {
+				if (tileHeights[i] && (oldest == index || tileHeightsUsed[i].load(std::memory_order_relaxed) < tileHeightsUsed[oldest].load(std::memory_order_relaxed))) {
+					oldest = i;
+				}
+			}
+			if (oldest != index) {
+				tileHeights[oldest].reset();
+				cachedTileHeights--;
+			}
+		}
+		tileHeights[index] = heights;
+		cachedTileHeights++;
+	}
+	tileHeightsUsed[index].store(++tileHeightsClock, std::memory_order_relaxed);
+	return tileHeights[index];
+}
+
+glm::vec2 Terrain::texelsPerTile(const Heightfield& heights) const {
+	if (source) {
+		//the same texels per tile loadTile cuts out
+		return glm::vec2((heights.getWidth() - 1) / info.tilesX, (heights.getHeight() - 1) / info.tilesZ);
+	}
+	return glm::vec2(heights.getWidth() - 1, heights.getHeight() - 1);
+}
+
+glm::vec2 Terrain::queryTexel(const glm::vec2& position, const glm::uvec2& tile, const Heightfield& heights) const {
+	glm::vec2 tiles = glm::clamp(position / info.tileSize, glm::vec2(0.f), glm::vec2(info.tilesX, info.tilesZ));
+	return (tiles - glm::vec2(tile)) * texelsPerTile(heights);
+}
+
+float Terrain::getHeight(float x, float z) const {
+	glm::vec2 position(x, z);
+	glm::uvec2 tile = queryTile(position);
+	auto heights = getTileHeights(tile);
+	glm::vec2 texel = queryTexel(position, tile, *heights);
+	//heights displace towards -y
+	return -heights->sampleBilinear(texel.x, texel.y) * info.heightScale;
+}
+
+glm::vec3 Terrain::getNormal(float x, float z) const {
+	glm::vec2 position(x, z);
+	glm::uvec2 tile = queryTile(position);
+	auto heights = getTileHeights(tile);
+	glm::vec2 texel = queryTexel(position, tile, *heights);
+	float texelSize = info.tileSize / glm::max(texelsPerTile(*heights).x, 1.f);
+
+	//sobel normals of the four texels around the position blended like sampleBilinear blends heights
+	texel = glm::clamp(texel, glm::vec2(0.f), glm::vec2(heights->getWidth() - 1, heights->getHeight() - 1));
+	glm::ivec2 first = glm::ivec2(texel);
+	glm::vec2 fraction = texel - glm::vec2(first);
+
+	//the stencils reach one texel past the tile, tiles share their border texels so texel -1 is the neighbour's second to last
+	//only the map border clamps
+	std::shared_ptr<const Heightfield> neighbours[3][3];
+	neighbours[1][1] = heights;
+	auto fetch = [&](int32_t x, int32_t z) {
+		glm::ivec2 step(0);
+		if (!source) {
+			step.x = x < 0 ? -1 : (x >= static_cast<int32_t>(heights->getWidth()) ? 1 : 0);
+			step.y = z < 0 ? -1 : (z >= static_cast<int32_t>(heights->getHeight()) ? 1 : 0);
+			glm::ivec2 neighbour = glm::ivec2(tile) + step;
+			if (neighbour.x < 0 || neighbour.x >= static_cast<int32_t>(info.tilesX)) {
+				step.x = 0;
+			}
+			if (neighbour.y < 0 || neighbour.y >= static_cast<int32_t>(info.tilesZ)) {
+				step.y = 0;
+			}
+		}
+		auto& field = neighbours[step.y + 1][step.x + 1];
+		if (!field) {
+			field = getTileHeights(glm::uvec2(glm::ivec2(tile) + step));
+		}
+		x += step.x > 0 ? 1 - static_cast<int32_t>(heights->getWidth()) : (step.x < 0 ? static_cast<int32_t>(field->getWidth()) - 1 : 0);
+		z += step.y > 0 ? 1 - static_cast<int32_t>(heights->getHeight()) : (step.y < 0 ? static_cast<int32_t>(field->getHeight()) - 1 : 0);
+		return field->at(x, z);
+	};
+	std::vector<uint16_t> samples(16);
+	for (int32_t z = 0; z < 4; z++) {
+		for (int32_t x = 0; x < 4; x++) {
+			samples[z * 4 + x] = fetch(first.x - 1 + x, first.y - 1 + z);
+		}
+	}
+	Heightfield stencil(4, 4, std::move(samples));
+
+	glm::vec3 top = glm::mix(stencil.normal(1, 1, texelSize, info.heightScale), stencil.normal(2, 1, texelSize, info.heightScale), fraction.x);
+	glm::vec3 bottom = glm::mix(stencil.normal(1, 2, texelSize, info.heightScale), stencil.normal(2, 2, texelSize, info.heightScale), fraction.x);
+	glm::vec3 normal = glm::normalize(glm::mix(top, bottom, fraction.y));
+	//the field's normal has y up, heights displace towards -y
+	return glm::vec3(normal.x, -normal.y, normal.z);
+}
+
+void Terrain::getHeights(const glm::vec2* positions, float* heights, size_t count) const {
+	const uint32_t batchSize = 1024;
+	uint32_t batches = static_cast<uint32_t>((count + batchSize - 1) / batchSize);
+
+	auto batch = [&](uint32_t index) {
+		size_t begin = static_cast<size_t>(index) * batchSize;
+		size_t end = std::min(count, begin + batchSize);
+		std::vector<glm::vec2> texels(end - begin);
+
+		//positions in the same tile are sampled as one run, so the heights are looked up once per run
+		size_t i = begin;
+		while (i < end) {
+			glm::uvec2 tile = queryTile(positions[i]);
+			auto tileHeights = getTileHeights(tile);
+			size_t runEnd = i;
+			do {
+				texels[runEnd - begin] = queryTexel(positions[runEnd], tile, *tileHeights);
+				runEnd++;
+			} while (runEnd < end && queryTile(positions[runEnd]) == tile);
+
+			tileHeights->sampleBilinear(texels.data() + (i - begin), heights + i, runEnd - i);
+			for (size_t j = i; j < runEnd; j++) {
+				heights[j] *= -info.heightScale;
+			}
+			i = runEnd;
+		}
+	};
+
+	if (batches <= 1) {
+		if (count > 0) {
+			batch(0);
+		}
+		return;
+	}
+	ThreadPool::global().parallelFor(batches, batch);
+}
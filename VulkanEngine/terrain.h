@@ -0,0 +1,214 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "glm/glm.hpp"
+
+#include "device.h"
+#include "renderer.h"
+#include "model.h"
+#include "texture.h"
+#include "constants.h"
+#include "computePipeline.h"
+#include "heightfield.h"
+#include "swapchain.h"
+
+//quadtree over a grid of heightmap tiles that are paged in from disk as the camera needs them
+//nodes above the tile level only group the culling, nodes below pick their lod by screen space error
+//every selected node draws the same patch grid, placed and textured through push constants
+//a compute pass derives a normal map and a min/max height mip chain from every uploaded tile
+class Terrain {
+public:
+	struct TerrainInfo {
+		//{x} and {z} are replaced by the tile coordinates, without them one heightfield is cut into the tiles
+		//16-bit pngs and raw .r16 files keep the full precision, .r16 is mapped instead of read
+		std::string tilePath;
+		uint32_t tilesX = 1;
+		uint32_t tilesZ = 1;
+		float tileSize = 256.f; //world units per tile side
+		float heightScale = 20.f;
+		uint32_t patchesPerNode = 8;
+		uint32_t maxDepth = 5; //quadtree levels below a tile
+		float maxScreenError = 48.f; //pixels a patch edge may cover before the node splits
+		uint32_t maxResidentTiles = 64;
+		float prefetchDistance = 256.f; //tiles this close to the camera load even when out of view
+	};
+
+	//pushed after the patch model's dequantization constants, read by the tessellation stages too
+	struct NodePush {
+		glm::vec4 rect{ 0.f }; //xz origin, size, patches per side
+		glm::vec4 uvRect{ 0.f }; //uv origin and extent in the tile's height texture
+		glm::vec4 neighbours{ 1.f }; //how many times larger the neighbour on -x, +x, -z, +z is
+	};
+
+	Terrain(Device& device, Renderer& renderer, std::shared_ptr<Texture> texture, const TerrainInfo& info);
+	~Terrain();
+
+	//delete copy constructors
+	Terrain(const Terrain&) = delete;
+	Terrain& operator=(const Terrain&) = delete;
+
+	//uploads finished loads and derives their normal and min/max maps
+	//has to be recorded outside of the render pass, before update
+	void prepare(VkCommandBuffer commandBuffer, int frameIndex);
+	//selects the nodes to draw this frame, camera and frustum are in the terrain's object space
+	//screenFactor converts a world size at distance one into pixels, viewport height * proj[1][1] / 2
+	void update(const glm::vec3& cameraPos, Constants::Frustum& frustum, float screenFactor);
+	void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout);
+
+	//patch grid of one node, gives the terrain game object its surface texture
+	std::shared_ptr<Model> getModel() const { return patchModel; }
+	const TerrainInfo& getInfo() const { return info; }
+	glm::vec2 getExtent() const { return glm::vec2(info.tilesX, info.tilesZ) * info.tileSize; }
+	uint32_t getSelectedNodeCount() const { return static_cast<uint32_t>(selectedNodes.size()); }
+	uint32_t getResidentTileCount() const { return residentCount; }
+
+	//cpu height queries in the terrain's object space, safe to call from any thread
+	//heights are y values of the surface, so negative like the drawn terrain, positions off the map clamp to its border
+	float getHeight(float x, float z) const;
+	//unit normal pointing away from the ground, towards -y
+	glm::vec3 getNormal(float x, float z) const;
+	//getHeight for count xz positions, large batches are split over the thread pool
+	void getHeights(const glm::vec2* positions, float* heights, size_t count) const;
+
+	//stages of the node push constant range in the terrain pipeline layout
+	static constexpr VkShaderStageFlags nodeStages = VK_SHADER_STAGE_VERTEX_BIT |
+		VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT |
+		VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+
+private:
+	//decoded on a loader thread, already in the texture format
+	struct TileData {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<uint8_t> pixels;
+		std::vector<std::vector<glm::vec2>> heightRanges; //min/max height per node, one grid per depth
+	};
+
+	//height texture plus what the compute pass derives from it, freed together
+	struct TileImage {
+		VkImage image = VK_NULL_HANDLE;
+		Allocation allocation{};
+		VkImageView view = VK_NULL_HANDLE;
+	};
+	struct TileResources {
+		TileImage heights;
+		TileImage normals;
+		TileImage minMax; //min and max height per cell between four texels, halved per mip level
+		std::vector<VkImageView> minMaxLevels; //storage views the compute pass writes
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	};
+
+	struct Tile {
+		enum class State { Unloaded, Loading, Resident, Failed };
+		State state = State::Unloaded;
+		std::future<std::shared_ptr<TileData>> pending;
+		uint64_t lastUsed = 0;
+
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<std::vector<glm::vec2>> heightRanges;
+		TileResources resources;
+	};
+
+	struct Node {
+		uint32_t level;
+		uint32_t x;
+		uint32_t z;
+		uint32_t tile;
+	};
+
+	//read by the normal pass, the tessellation shaders get the height scale from their ubo
+	struct DerivePush {
+		float heightScale;
+		float worldPerTexel;
+	};
+
+	static constexpr uint32_t maxPendingLoads = 4;
+	static constexpr uint32_t maxUploadsPerFrame = 2;
+	//enough min/max levels for tiles of up to 32768 texels per side
+	static constexpr uint32_t maxMinMaxLevels = 16;
+	static constexpr VkFormat normalFormat = VK_FORMAT_R8G8B8A8_SNORM;
+	static constexpr VkFormat minMaxFormat = VK_FORMAT_R32G32_SFLOAT;
+
+	Device& device;
+	Renderer& renderer;
+	TerrainInfo info;
+	VkFormat heightFormat;
+	uint32_t tileLevel; //quadtree level whose nodes are exactly one tile
+	float rootSize;
+
+	//only set when one heightfield is cut into tiles
+	std::shared_ptr<const Heightfield> source;
+	//cpu heights of tile files, filled by the loader threads and by queries on tiles that never streamed in
+	//at most as many as the resident and loading tiles, the least recently read one goes when another is added
+	mutable std::shared_mutex tileHeightsMutex;
+	mutable std::vector<std::shared_ptr<const Heightfield>> tileHeights;
+	mutable std::vector<std::atomic<uint64_t>> tileHeightsUsed;
+	mutable std::atomic<uint64_t> tileHeightsClock{ 0 };
+	mutable uint32_t cachedTileHeights = 0;
+
+	std::vector<Tile> tiles;
+	uint32_t residentCount = 0;
+	uint32_t pendingCount = 0;
+	uint64_t frame = 0;
+
+	std::vector<Node> selectedNodes;
+	std::unordered_set<uint64_t> selectedKeys;
+
+	std::shared_ptr<Model> patchModel;
+	VkSampler sampler;
+	VkDescriptorPool descriptorPool;
+
+	//tiles uploaded by prepare that still need their compute pass
+	std::vector<uint32_t> uploadedTiles;
+	//derive sets only live for one frame, each frame in flight resets its own pool
+	std::array<VkDescriptorPool, Swapchain::MAX_FRAMES_IN_FLIGHT> derivePools;
+	VkPipelineLayout derivePipelineLayout;
+	std::unique_ptr<ComputePipeline> normalPipeline;
+	std::unique_ptr<ComputePipeline> minMaxPipeline;
+
+	glm::vec3 cameraPos{ 0.f };
+	float screenFactor = 1.f;
+
+	float nodeSize(uint32_t level) const { return rootSize / static_cast<float>(1u << level); }
+	static uint64_t nodeKey(uint32_t level, uint32_t x, uint32_t z) {
+		return (static_cast<uint64_t>(level) << 58) | (static_cast<uint64_t>(x) << 29) | z;
+	}
+
+	void createPatchModel(std::shared_ptr<Texture> texture);
+	void createSampler();
+	void createDescriptorPool();
+	void createDerivePipelines();
+
+	void selectNode(uint32_t level, uint32_t x, uint32_t z, Constants::Frustum& frustum);
+	glm::vec2 nodeHeightRange(uint32_t level, uint32_t x, uint32_t z) const;
+	float neighbourRatio(uint32_t level, int32_t x, int32_t z) const;
+
+	void requestTile(uint32_t index);
+	void prefetchTiles();
+	void finishLoads();
+	void uploadTile(Tile& tile, TileData& data);
+	void createTileImage(TileImage& tileImage, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageUsageFlags usage);
+	void deriveTiles(VkCommandBuffer commandBuffer, int frameIndex);
+	VkDescriptorSet allocateDeriveSet(int frameIndex, VkImageView heights, VkImageView first, VkImageView second);
+	void evictTiles();
+	void destroyTileResources(TileResources& resources);
+
+	std::shared_ptr<TileData> loadTile(uint32_t x, uint32_t z) const;
+
+	//heights a query reads, the whole source is one tile when a single heightfield is cut up
+	glm::uvec2 queryTile(const glm::vec2& position) const;
+	std::shared_ptr<const Heightfield> getTileHeights(const glm::uvec2& tile) const;
+	glm::vec2 texelsPerTile(const Heightfield& heights) const;
+	glm::vec2 queryTexel(const glm::vec2& position, const glm::uvec2& tile, const Heightfield& heights) const;
+};
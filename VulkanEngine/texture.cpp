@@ -1,129 +1,88 @@
 #include "texture.h"
 
+#include <cstring>
 #include <iterator>
+#include <stdexcept>
+#include <vector>
 
 #include "spdlog/spdlog.h"
 #include "stb_image.h"
 
 #include "device.h"
+#include "uploadManager.h"
 
 
 Texture::~Texture() {
 	vkDestroyImageView(device.device(), textureImageView, nullptr);
-    vkDestroyImage(device.device(), textureImage, nullptr);
-    vkFreeMemory(device.device(), textureImageMemory, nullptr);
+    device.destroyImage(textureImage, textureImageAllocation);
 }
 
-void Texture::createTexture(std::string filepath) {
+//flipping here instead of through stbi_set_flip_vertically_on_load keeps decoding free of global state
+static void flipRows(unsigned char* pixels, uint32_t width, uint32_t height) {
+    size_t rowSize = static_cast<size_t>(width) * 4;
+    std::vector<unsigned char> row(rowSize);
+    for (uint32_t y = 0; y < height / 2; y++) {
+        unsigned char* top = pixels + y * rowSize;
+        unsigned char* bottom = pixels + (height - 1 - y) * rowSize;
+        memcpy(row.data(), top, rowSize);
+        memcpy(top, bottom, rowSize);
+        memcpy(bottom, row.data(), rowSize);
+    }
+}
+
+Texture::ImageData Texture::ImageData::load(const std::string& filepath, bool flipped) {
+    ImageData image{};
     int texWidth, texHeight, texChannels;
     stbi_uc* pixels = stbi_load(filepath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
 
     if (!pixels) {
-        spdlog::critical("Failed to load texture image");
+        spdlog::critical("Failed to load texture image {}", filepath);
+        throw std::runtime_error("load");
+    }
+    if (flipped) {
+        flipRows(pixels, texWidth, texHeight);
     }
 
-    //TODO: reworkd to use buffer class
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    device.createBuffer(imageSize, 
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-        stagingBuffer, 
-        stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(device.device(), stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(device.device(), stagingBufferMemory);
-
-    stbi_image_free(pixels);
-    createImage(texWidth, 
-        texHeight, 
-        VK_FORMAT_R8G8B8A8_SRGB, 
-        VK_IMAGE_TILING_OPTIMAL, 
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-        1,
-        false,
-        textureImage, 
-        textureImageMemory);
-
-
-	transitionImageLayout(textureImage, 
-        VK_FORMAT_R8G8B8A8_SRGB, 
-        1,
-        VK_IMAGE_LAYOUT_UNDEFINED, 
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    device.copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1);
-    transitionImageLayout(textureImage, 
-        VK_FORMAT_R8G8B8A8_SRGB, 
-        1,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
-    vkFreeMemory(device.device(), stagingBufferMemory, nullptr);
+    image.width = static_cast<uint32_t>(texWidth);
+    image.height = static_cast<uint32_t>(texHeight);
+    image.layers.emplace_back(pixels, stbi_image_free);
+    return image;
 }
 
-void Texture::createCubemap(std::array<std::string, 6> filenames) {
-	std::array<stbi_uc*, 6> pixels{};
-	int texWidth, texHeight, texChannels;
-	VkDeviceSize imageSize;
-	for (int i = 0; i < 6; i++) {
-		pixels[i] = stbi_load(filenames[i].c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-		imageSize = texWidth * texHeight * 4;
-
-		if (!pixels[i]) {
-			spdlog::critical("Failed to load texture image");
-		}
-	}
-
-    //TODO: reworkd to use buffer class
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    device.createBuffer(imageSize * 6, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(device.device(), stagingBufferMemory, 0, imageSize * 6, 0, &data);
-    for (int i = 0; i < pixels.size(); i++) {
-	    char *memOffset = (char *)data;
-		memOffset += imageSize * i;
-		memcpy(memOffset, pixels[i], static_cast<size_t>(imageSize));
-        //memcpy(data + (imageSize * i), pixels[i], static_cast<size_t>(imageSize));
+Texture::ImageData Texture::ImageData::loadCubemap(const std::array<std::string, 6>& filepaths, bool flipped) {
+    ImageData image{};
+    image.cube = true;
+    for (auto& filepath : filepaths) {
+        ImageData face = load(filepath, flipped);
+        if (!image.layers.empty() && (face.width != image.width || face.height != image.height)) {
+            spdlog::critical("Cubemap face {} doesn't match the other faces", filepath);
+            throw std::runtime_error("loadCubemap");
+        }
+        image.width = face.width;
+        image.height = face.height;
+        image.layers.push_back(std::move(face.layers[0]));
     }
-	//std::copy_n(pixels.begin(), static_cast<size_t>(imageSize * 6), data);
-    vkUnmapMemory(device.device(), stagingBufferMemory);
+    return image;
+}
 
-	for (int i = 0; i < 6; i++) {
-		stbi_image_free(pixels[i]);
-	}
-    createImage(texWidth, 
-        texHeight, 
+void Texture::createTexture(const ImageData& image) {
+    createImage(image.width, 
+        image.height, 
         VK_FORMAT_R8G8B8A8_SRGB, 
         VK_IMAGE_TILING_OPTIMAL, 
         VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-        6, 
-        true,
+        static_cast<uint32_t>(image.layers.size()),
+        image.cube,
         textureImage, 
-        textureImageMemory);
-
-
-	Texture::transitionImageLayout(textureImage, 
-        VK_FORMAT_R8G8B8A8_SRGB, 
-        6,
-        VK_IMAGE_LAYOUT_UNDEFINED, 
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    device.copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 6);
-    Texture::transitionImageLayout(textureImage, 
-        VK_FORMAT_R8G8B8A8_SRGB, 
-        6,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        textureImageAllocation);
 
-    vkDestroyBuffer(device.device(), stagingBuffer, nullptr);
-    vkFreeMemory(device.device(), stagingBufferMemory, nullptr);
+    //every layer goes straight from the decoded pixels into the staging memory
+    std::vector<const void*> layers;
+    for (auto& layer : image.layers) {
+        layers.push_back(layer.get());
+    }
+    device.uploader().uploadImage(layers, image.layerSize(), textureImage, image.width, image.height);
 }
 
 
@@ -136,7 +95,7 @@ void Texture::createImage(uint32_t width,
         uint32_t arrayLayers, 
         bool cube,
         VkImage& image, 
-        VkDeviceMemory& imageMemory) {
+        Allocation& allocation) {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -155,75 +114,9 @@ void Texture::createImage(uint32_t width,
         imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
     }
 
-    if (vkCreateImage(device.device(), &imageInfo, nullptr, &image) != VK_SUCCESS) {
-        spdlog::critical("Failed to create image");
-    }
-
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device.device(), image, &memRequirements);
-    
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = device.findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device.device(), &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
-    }
-
-    vkBindImageMemory(device.device(), image, imageMemory, 0);
+    device.createImageWithInfo(imageInfo, properties, image, allocation);
 }
 
-void Texture::transitionImageLayout(VkImage image, 
-        VkFormat format, 
-        uint32_t arrayLayers,
-        VkImageLayout oldLayout, 
-        VkImageLayout newLayout) {
-	VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
-
-	VkImageMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = oldLayout;
-	barrier.newLayout = newLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = arrayLayers;
-
-	VkPipelineStageFlags sourceStage;
-	VkPipelineStageFlags destinationStage;
-
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	} else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	} else {
-		spdlog::critical("Unsupported layout transition");
-	}
-
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		sourceStage, destinationStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
-
-	device.endSingleTimeCommands(commandBuffer);
-}
 void Texture::createTextureImageView(uint32_t arrayLayers, VkImageViewType imageViewType) {
 	textureImageView = createImageView(textureImage, arrayLayers, imageViewType, VK_FORMAT_R8G8B8A8_SRGB);
 }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <array>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <vulkan/vulkan.h>
 
@@ -9,14 +11,25 @@
 
 class Texture {
 public:
-	Texture(Device& device, std::string filepath) : device{ device }{
-		createTexture(filepath);
-		createTextureImageView(1, VK_IMAGE_VIEW_TYPE_2D);
+	//decoded pixels only touch the cpu, so they can be produced on any thread
+	struct ImageData {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		bool cube = false;
+		std::vector<std::unique_ptr<unsigned char, void(*)(void*)>> layers; //rgba8, one per array layer
+
+		VkDeviceSize layerSize() const { return static_cast<VkDeviceSize>(width) * height * 4; }
+
+		static ImageData load(const std::string& filepath, bool flipped = false);
+		static ImageData loadCubemap(const std::array<std::string, 6>& filepaths, bool flipped = false);
 	};
-	Texture(Device& device, std::array<std::string, 6> filepaths) : device{ device }{
-		createCubemap(filepaths);
-		createTextureImageView(6, VK_IMAGE_VIEW_TYPE_CUBE);
+
+	Texture(Device& device, const ImageData& image) : device{ device }{
+		createTexture(image);
+		createTextureImageView(static_cast<uint32_t>(image.layers.size()), image.cube ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D);
 	};
+	Texture(Device& device, std::string filepath, bool flipped = false) : Texture(device, ImageData::load(filepath, flipped)) {};
+	Texture(Device& device, std::array<std::string, 6> filepaths, bool flipped = false) : Texture(device, ImageData::loadCubemap(filepaths, flipped)) {};
 	~Texture();
 
 
@@ -27,17 +40,13 @@ private:
 	Device& device;
 
 	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	Allocation textureImageAllocation;
 
 	VkImageView textureImageView;
 
-	void createTexture(std::string filepath);
+	void createTexture(const ImageData& image);
 	void createTextureImageView(uint32_t arrayLayers, VkImageViewType imageViewType);
 
-	void createCubemap(std::array<std::string, 6> filepaths);
-
 	void createImage(uint32_t width, 
 		uint32_t height, 
 		VkFormat format, 
@@ -47,15 +56,10 @@ private:
 		uint32_t arrayLayers, 
 		bool cube, 
 		VkImage& image, 
-		VkDeviceMemory& imageMemory);
+		Allocation& allocation);
 	VkImageView createImageView(VkImage image, 
 		uint32_t arrayLayers, 
 		VkImageViewType imageViewType, 
 		VkFormat format);
-	void transitionImageLayout(VkImage image, 
-		VkFormat format, 
-		uint32_t arrayLayers, 
-		VkImageLayout oldLayout, 
-		VkImageLayout newLayout);
 };
 
@@ -0,0 +1,119 @@
+#include "threadPool.h"
+
+#include <algorithm>
+#include <exception>
+
+static thread_local bool insideWorker = false;
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	workers.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+ThreadPool& ThreadPool::global() {
+	static ThreadPool pool{};
+	return pool;
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)>& job) {
+	if (insideWorker || count <= 1 || workers.size() <= 1) {
+		for (uint32_t i = 0; i < count; i++) {
+			job(i);
+		}
+		return;
+	}
+
+	//shared with the helpers, a helper that only starts after the loop is done finds no work and returns
+	struct Loop {
+		std::function<void(uint32_t)> job;
+		uint32_t count;
+		std::atomic<uint32_t> next{ 0 };
+		std::atomic<uint32_t> active{ 0 };
+		std::mutex mutex;
+		std::condition_variable finished;
+		std::exception_ptr error;
+	};
+	auto loop = std::make_shared<Loop>();
+	loop->job = job;
+	loop->count = count;
+
+	auto run = [](Loop& loop) {
+		try {
+			for (uint32_t i = loop.next++; i < loop.count; i = loop.next++) {
+				loop.job(i);
+			}
+		}
+		catch (...) {
+			//stop handing out indices, the first error is rethrown on the calling thread
+			loop.next = loop.count;
+			std::lock_guard<std::mutex> lock(loop.mutex);
+			if (!loop.error) {
+				loop.error = std::current_exception();
+			}
+		}
+	};
+
+	uint32_t helperCount = std::min(count - 1, static_cast<uint32_t>(workers.size()));
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (uint32_t i = 0; i < helperCount; i++) {
+			jobs.push([loop, run]() {
+				{
+					std::lock_guard<std::mutex> lock(loop->mutex);
+					if (loop->next >= loop->count) {
+						return;
+					}
+					loop->active++;
+				}
+				run(*loop);
+				std::lock_guard<std::mutex> lock(loop->mutex);
+				if (--loop->active == 0) {
+					loop->finished.notify_all();
+				}
+			});
+		}
+	}
+	condition.notify_all();
+
+	run(*loop);
+
+	//only helpers that started can still be inside job, queued ones return on their own
+	std::unique_lock<std::mutex> lock(loop->mutex);
+	loop->finished.wait(lock, [&]() { return loop->active == 0; });
+	if (loop->error) {
+		std::rethrow_exception(loop->error);
+	}
+}
+
+void ThreadPool::workerLoop() {
+	insideWorker = true;
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&]() { return stopping || !jobs.empty(); });
+			if (stopping && jobs.empty()) {
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop();
+		}
+		job();
+	}
+}
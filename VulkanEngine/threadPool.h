@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+	//0 uses one worker per hardware thread
+	ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+
+	//delete copy constructors
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	template <typename F>
+	auto submit(F&& job) -> std::future<decltype(job())> {
+		using Result = decltype(job());
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+		std::future<Result> result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push([task]() { (*task)(); });
+		}
+		condition.notify_one();
+		return result;
+	}
+
+	//runs job(i) for every i in [0, count) on the pool and the calling thread
+	//runs inline when called from a worker, so jobs can use it without starving the pool
+	//helpers queue behind other jobs, the caller only waits for the ones that started before the work ran out
+	void parallelFor(uint32_t count, const std::function<void(uint32_t)>& job);
+
+	uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+	//shared pool for loading work
+	static ThreadPool& global();
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping = false;
+
+	void workerLoop();
+};
@@ -0,0 +1,359 @@
+#include "uploadManager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "spdlog/spdlog.h"
+
+UploadManager::UploadManager(Device& device) : device{ device }, stagingArena{ device, stagingArenaSize } {
+	//buffer to image copies need offsets aligned to the texel size, 16 covers every format we upload
+	stagingAlignment = std::max<VkDeviceSize>(16, device.properties.limits.optimalBufferCopyOffsetAlignment);
+
+	QueueFamilyIndices indices = device.findPhysicalQueueFamilies();
+	dedicatedTransfer = device.hasDedicatedTransferQueue();
+	graphicsFamily = indices.graphicsFamily;
+	transferFamily = dedicatedTransfer ? indices.transferFamily : indices.graphicsFamily;
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	poolInfo.queueFamilyIndex = transferFamily;
+	if (vkCreateCommandPool(device.device(), &poolInfo, nullptr, &transferPool) != VK_SUCCESS) {
+		spdlog::critical("Failed to create upload command pool");
+		throw std::runtime_error("UploadManager");
+	}
+
+	if (dedicatedTransfer) {
+		poolInfo.queueFamilyIndex = graphicsFamily;
+		if (vkCreateCommandPool(device.device(), &poolInfo, nullptr, &graphicsPool) != VK_SUCCESS) {
+			spdlog::critical("Failed to create upload command pool");
+			throw std::runtime_error("UploadManager");
+		}
+		spdlog::debug("Uploading on dedicated transfer queue family {}", transferFamily);
+	}
+}
+
+UploadManager::~UploadManager() {
+	submit();
+	waitIdle();
+
+	vkDestroyCommandPool(device.device(), transferPool, nullptr);
+	if (graphicsPool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(device.device(), graphicsPool, nullptr);
+	}
+}
+
+void UploadManager::uploadBuffer(const void* data,
+		VkDeviceSize size,
+		VkBuffer dstBuffer,
+		VkDeviceSize dstOffset,
+		VkAccessFlags dstAccessMask,
+		VkPipelineStageFlags dstStageMask) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Batch& batch = getOpenBatch();
+
+	StagingAllocation staging = allocateStaging(batch, size);
+	memcpy(staging.mapped, data, static_cast<size_t>(size));
+
+	VkBufferCopy copyRegion{};
+	copyRegion.srcOffset = staging.offset;
+	copyRegion.dstOffset = dstOffset;
+	copyRegion.size = size;
+	vkCmdCopyBuffer(batch.transferCommands, staging.buffer, dstBuffer, 1, &copyRegion);
+	batch.copyCount++;
+
+	//with a dedicated queue this is the release half of the ownership transfer, otherwise a plain barrier
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dedicatedTransfer ? 0 : dstAccessMask;
+	barrier.srcQueueFamilyIndex = dedicatedTransfer ? transferFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = dedicatedTransfer ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = dstBuffer;
+	barrier.offset = dstOffset;
+	barrier.size = size;
+	batch.bufferBarriers.push_back(barrier);
+
+	//the acquire half is recorded on the graphics queue with the real destination access
+	barrier.srcAccessMask = dedicatedTransfer ? 0 : barrier.srcAccessMask;
+	barrier.dstAccessMask = dstAccessMask;
+	if (dedicatedTransfer) {
+		vkCmdPipelineBarrier(batch.acquireCommands,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStageMask,
+			0,
+			0, nullptr,
+			1, &barrier,
+			0, nullptr);
+	}
+	batch.dstStageMask |= dstStageMask;
+}
+
+void UploadManager::uploadImage(const std::vector<const void*>& layers,
+		VkDeviceSize layerSize,
+		VkImage image,
+		uint32_t width,
+		uint32_t height) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Batch& batch = getOpenBatch();
+
+	uint32_t layerCount = static_cast<uint32_t>(layers.size());
+	StagingAllocation staging = allocateStaging(batch, layerSize * layerCount);
+	for (uint32_t i = 0; i < layerCount; i++) {
+		memcpy(static_cast<char*>(staging.mapped) + layerSize * i, layers[i], static_cast<size_t>(layerSize));
+	}
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = layerCount;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(batch.transferCommands,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	VkBufferImageCopy region{};
+	region.bufferOffset = staging.offset;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = layerCount;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { width, height, 1 };
+
+	vkCmdCopyBufferToImage(batch.transferCommands,
+		staging.buffer,
+		image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1,
+		&region);
+	batch.copyCount++;
+
+	//the layout change rides along with the ownership transfer when there is one
+	VkPipelineStageFlags shaderStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+		VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = dedicatedTransfer ? 0 : VK_ACCESS_SHADER_READ_BIT;
+	barrier.srcQueueFamilyIndex = dedicatedTransfer ? transferFamily : VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = dedicatedTransfer ? graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+	batch.imageBarriers.push_back(barrier);
+
+	if (dedicatedTransfer) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(batch.acquireCommands,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, shaderStages,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+	}
+	batch.dstStageMask |= shaderStages;
+}
+
+UploadTicket UploadManager::submit() {
+	std::lock_guard<std::mutex> lock(mutex);
+	collect();
+
+	if (!openBatch) {
+		return nextTicket - 1;
+	}
+	std::unique_ptr<Batch> batch = std::move(openBatch);
+
+	//one barrier call for every release/transition in the batch, transfer queues only know the transfer stage
+	VkPipelineStageFlags releaseStage = dedicatedTransfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : batch->dstStageMask;
+	vkCmdPipelineBarrier(batch->transferCommands,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, releaseStage,
+		0,
+		0, nullptr,
+		static_cast<uint32_t>(batch->bufferBarriers.size()), batch->bufferBarriers.data(),
+		static_cast<uint32_t>(batch->imageBarriers.size()), batch->imageBarriers.data());
+	vkEndCommandBuffer(batch->transferCommands);
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	vkCreateFence(device.device(), &fenceInfo, nullptr, &batch->fence);
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch->transferCommands;
+
+	if (dedicatedTransfer) {
+		vkEndCommandBuffer(batch->acquireCommands);
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &batch->transferDone);
+
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &batch->transferDone;
+		if (vkQueueSubmit(device.transferQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+			spdlog::critical("Failed to submit upload batch");
+			throw std::runtime_error("submit");
+		}
+
+		//the fence sits on the acquire so completion means the resources are usable on the graphics queue
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		VkSubmitInfo acquireInfo{};
+		acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireInfo.waitSemaphoreCount = 1;
+		acquireInfo.pWaitSemaphores = &batch->transferDone;
+		acquireInfo.pWaitDstStageMask = &waitStage;
+		acquireInfo.commandBufferCount = 1;
+		acquireInfo.pCommandBuffers = &batch->acquireCommands;
+		if (vkQueueSubmit(device.graphicsQueue(), 1, &acquireInfo, batch->fence) != VK_SUCCESS) {
+			spdlog::critical("Failed to submit upload acquire");
+			throw std::runtime_error("submit");
+		}
+	}
+	else if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, batch->fence) != VK_SUCCESS) {
+		spdlog::critical("Failed to submit upload batch");
+		throw std::runtime_error("submit");
+	}
+
+	UploadTicket ticket = batch->ticket;
+	spdlog::debug("Submitted upload batch {} with {} copies", ticket, batch->copyCount);
+	inFlight.push_back(std::move(batch));
+	return ticket;
+}
+
+bool UploadManager::isComplete(UploadTicket ticket) {
+	std::lock_guard<std::mutex> lock(mutex);
+	collect();
+
+	if (openBatch && openBatch->ticket == ticket) {
+		return false;
+	}
+	return std::none_of(inFlight.begin(), inFlight.end(), [&](const std::unique_ptr<Batch>& batch) { return batch->ticket == ticket; });
+}
+
+void UploadManager::wait(UploadTicket ticket) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (openBatch && openBatch->ticket == ticket) {
+		spdlog::warn("Waiting on upload batch {} before it was submitted", ticket);
+		return;
+	}
+	for (auto& batch : inFlight) {
+		if (batch->ticket == ticket) {
+			vkWaitForFences(device.device(), 1, &batch->fence, VK_TRUE, UINT64_MAX);
+			break;
+		}
+	}
+	collect();
+}
+
+void UploadManager::waitIdle() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& batch : inFlight) {
+		vkWaitForFences(device.device(), 1, &batch->fence, VK_TRUE, UINT64_MAX);
+	}
+	collect();
+}
+
+UploadManager::Batch& UploadManager::getOpenBatch() {
+	if (openBatch) {
+		return *openBatch;
+	}
+
+	openBatch = std::make_unique<Batch>();
+	openBatch->ticket = nextTicket++;
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	openBatch->transferCommands = allocateCommandBuffer(transferPool);
+	vkBeginCommandBuffer(openBatch->transferCommands, &beginInfo);
+	if (dedicatedTransfer) {
+		openBatch->acquireCommands = allocateCommandBuffer(graphicsPool);
+		vkBeginCommandBuffer(openBatch->acquireCommands, &beginInfo);
+	}
+	return *openBatch;
+}
+
+StagingAllocation UploadManager::allocateStaging(Batch& batch, VkDeviceSize size) {
+	StagingAllocation allocation{};
+	if (stagingArena.allocate(size, stagingAlignment, batch.ticket, allocation)) {
+		return allocation;
+	}
+
+	//finished batches may be holding the space we need
+	collect();
+	if (stagingArena.allocate(size, stagingAlignment, batch.ticket, allocation)) {
+		return allocation;
+	}
+
+	//too big for the arena or the arena is full of in flight data
+	auto staging = std::make_unique<Buffer>(
+		device, size, 1,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	staging->map();
+	allocation.buffer = staging->getBuffer();
+	allocation.offset = 0;
+	allocation.mapped = staging->getMappedMemory();
+	batch.stagingBuffers.push_back(std::move(staging));
+	return allocation;
+}
+
+VkCommandBuffer UploadManager::allocateCommandBuffer(VkCommandPool pool) {
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = pool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(device.device(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+		spdlog::critical("Failed to allocate upload command buffer");
+		throw std::runtime_error("allocateCommandBuffer");
+	}
+	return commandBuffer;
+}
+
+//releases staging memory and command buffers of every batch the gpu has finished
+void UploadManager::collect() {
+	for (auto it = inFlight.begin(); it != inFlight.end();) {
+		if (vkGetFenceStatus(device.device(), (*it)->fence) == VK_SUCCESS) {
+			retire(**it);
+			it = inFlight.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+}
+
+void UploadManager::retire(Batch& batch) {
+	vkDestroyFence(device.device(), batch.fence, nullptr);
+	vkFreeCommandBuffers(device.device(), transferPool, 1, &batch.transferCommands);
+	if (dedicatedTransfer) {
+		vkDestroySemaphore(device.device(), batch.transferDone, nullptr);
+		vkFreeCommandBuffers(device.device(), graphicsPool, 1, &batch.acquireCommands);
+	}
+	batch.stagingBuffers.clear();
+	stagingArena.release(batch.ticket);
+}
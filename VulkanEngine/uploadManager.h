@@ -0,0 +1,82 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "device.h"
+#include "buffer.h"
+#include "stagingArena.h"
+
+//records staging copies into one command buffer per batch instead of a submit and wait per copy
+//uploads are recorded into the open batch until submit(), the returned ticket can then be polled or waited on
+class UploadManager {
+public:
+	UploadManager(Device& device);
+	~UploadManager();
+
+	//delete copy constructors
+	UploadManager(const UploadManager&) = delete;
+	UploadManager& operator=(const UploadManager&) = delete;
+
+	//data is copied into staging memory straight away, so it can be freed after the call
+	void uploadBuffer(const void* data,
+		VkDeviceSize size,
+		VkBuffer dstBuffer,
+		VkDeviceSize dstOffset = 0,
+		VkAccessFlags dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+		VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	//transitions the whole image to shader read only, one pointer per array layer
+	void uploadImage(const std::vector<const void*>& layers,
+		VkDeviceSize layerSize,
+		VkImage image,
+		uint32_t width,
+		uint32_t height);
+
+	//submits the open batch, returns the ticket of the last submitted batch if nothing was recorded
+	UploadTicket submit();
+	bool isComplete(UploadTicket ticket);
+	void wait(UploadTicket ticket);
+	void waitIdle();
+
+private:
+	struct Batch {
+		UploadTicket ticket;
+		VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+		//acquires queue family ownership on the graphics queue, only used with a dedicated transfer queue
+		VkCommandBuffer acquireCommands = VK_NULL_HANDLE;
+		VkSemaphore transferDone = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		//only holds staging that didn't fit in the arena
+		std::vector<std::unique_ptr<Buffer>> stagingBuffers;
+		uint32_t copyCount = 0;
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		VkPipelineStageFlags dstStageMask = 0;
+	};
+
+	static constexpr VkDeviceSize stagingArenaSize = 64ull * 1024 * 1024;
+
+	Device& device;
+	StagingArena stagingArena;
+	VkDeviceSize stagingAlignment;
+	bool dedicatedTransfer;
+	uint32_t transferFamily;
+	uint32_t graphicsFamily;
+	VkCommandPool transferPool = VK_NULL_HANDLE;
+	VkCommandPool graphicsPool = VK_NULL_HANDLE;
+
+	std::unique_ptr<Batch> openBatch;
+	std::deque<std::unique_ptr<Batch>> inFlight;
+	UploadTicket nextTicket = 1;
+	std::mutex mutex;
+
+	Batch& getOpenBatch();
+	StagingAllocation allocateStaging(Batch& batch, VkDeviceSize size);
+	VkCommandBuffer allocateCommandBuffer(VkCommandPool pool);
+	void collect();
+	void retire(Batch& batch);
+};
@@ -0,0 +1,84 @@
+#include "waterSurface.h"
+
+#include <cmath>
+
+#include "spdlog/spdlog.h"
+
+#include "gridGenerator.h"
+
+WaterSurface::WaterSurface(Device& device, std::shared_ptr<Texture> texture, uint32_t levels, uint32_t chunkCells, float baseCellSize)
+		: chunkCells{ chunkCells }, baseCellSize{ baseCellSize } {
+	uint32_t vertexCount = 0;
+	for (uint32_t level = 0; level < levels; level++) {
+		//every chunk of a level is the same grid, chunks only differ by the offset pushed when drawing
+		GridGenerator::GridInfo info{};
+		info.cellsX = chunkCells;
+		info.cellsZ = chunkCells;
+		info.cellSize = cellSize(level);
+		info.parallel = false;
+
+		Model::Geometry geometry;
+		GridGenerator::generate(info, geometry);
+		vertexCount += geometry.vertexCount();
+		levelModels.push_back(std::make_shared<Model>(device, geometry, texture, Model::VertexFormat::Packed));
+
+		for (int z = 0; z < 4; z++) {
+			for (int x = 0; x < 4; x++) {
+				bool inner = x >= 1 && x <= 2 && z >= 1 && z <= 2;
+				if (level > 0 && inner) {
+					continue;
+				}
+				chunks.push_back({ level, glm::vec2(x - 2, z - 2) * chunkSize(level) });
+			}
+		}
+	}
+	visibleChunks.reserve(chunks.size());
+
+	spdlog::debug("Water clipmap: {} levels, {} chunks, {} vertices, {:.0f} units across",
+		levels,
+		chunks.size(),
+		vertexCount,
+		getExtent());
+}
+
+float WaterSurface::getExtent() const {
+	return 4.f * chunkSize(static_cast<uint32_t>(levelModels.size()) - 1);
+}
+
+void WaterSurface::update(const glm::vec3& cameraPos, Constants::Frustum& frustum, float waveHeight) {
+	//all levels share one center snapped to the coarsest cell, so the rings nest exactly and
+	//vertices never slide across the waves, the finest level is wide enough to absorb the snapping
+	float snap = 2.f * cellSize(static_cast<uint32_t>(levelModels.size()) - 1);
+	center = glm::vec2(std::floor(cameraPos.x / snap + .5f), std::floor(cameraPos.z / snap + .5f)) * snap;
+
+	visibleChunks.clear();
+	for (uint32_t i = 0; i < chunks.size(); i++) {
+		const Chunk& chunk = chunks[i];
+		float halfSize = 0.5f * chunkSize(chunk.level);
+		glm::vec2 middle = center + chunk.offset + glm::vec2(halfSize);
+		float radius = std::sqrt(2.f * halfSize * halfSize + waveHeight * waveHeight);
+		if (frustum.checkSphere(glm::vec3(middle.x, 0.f, middle.y), radius)) {
+			visibleChunks.push_back(i);
+		}
+	}
+}
+
+void WaterSurface::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) {
+	int32_t boundLevel = -1;
+	for (uint32_t i : visibleChunks) {
+		const Chunk& chunk = chunks[i];
+		Model& model = *levelModels[chunk.level];
+		if (static_cast<int32_t>(chunk.level) != boundLevel) {
+			model.bind(commandBuffer);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(Model::Dequantization), &model.getDequantization());
+			boundLevel = static_cast<int32_t>(chunk.level);
+		}
+
+		ChunkPush push{};
+		glm::vec2 origin = center + chunk.offset;
+		push.offset = glm::vec4(origin.x, 0.f, origin.y, 0.f);
+		push.ring = glm::vec4(center.x, center.y, 2.f * chunkSize(chunk.level), cellSize(chunk.level));
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(Model::Dequantization), sizeof(ChunkPush), &push);
+		model.draw(commandBuffer);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "glm/glm.hpp"
+
+#include "device.h"
+#include "model.h"
+#include "texture.h"
+#include "constants.h"
+
+//geometry clipmap for the water: concentric rings of reusable chunk grids around the camera
+//level 0 is a full 4x4 chunk square, every further level doubles the cell size and leaves out the inner 2x2 chunks
+class WaterSurface {
+public:
+	//pushed after the model's dequantization constants for every chunk drawn
+	struct ChunkPush {
+		glm::vec4 offset{ 0.f }; //xz origin of the chunk in object space
+		glm::vec4 ring{ 0.f }; //xz center of the rings, half extent and cell size of the chunk's level
+	};
+
+	WaterSurface(Device& device, std::shared_ptr<Texture> texture, uint32_t levels = 6, uint32_t chunkCells = 32, float baseCellSize = 0.25f);
+
+	//delete copy constructors
+	WaterSurface(const WaterSurface&) = delete;
+	WaterSurface& operator=(const WaterSurface&) = delete;
+
+	//recenters the rings on the camera (object space) and keeps the chunks inside the frustum
+	//waveHeight pads the chunk bounds for the vertical displacement done in the shader
+	void update(const glm::vec3& cameraPos, Constants::Frustum& frustum, float waveHeight = 4.f);
+	void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout);
+
+	//level 0 chunk, gives the water game object its texture
+	std::shared_ptr<Model> getModel() const { return levelModels[0]; }
+	uint32_t getChunkCount() const { return static_cast<uint32_t>(chunks.size()); }
+	uint32_t getVisibleChunkCount() const { return static_cast<uint32_t>(visibleChunks.size()); }
+	float getExtent() const;
+
+private:
+	struct Chunk {
+		uint32_t level;
+		glm::vec2 offset; //relative to the ring center
+	};
+
+	uint32_t chunkCells;
+	float baseCellSize;
+	glm::vec2 center{ 0.f };
+
+	std::vector<std::shared_ptr<Model>> levelModels;
+	std::vector<Chunk> chunks;
+	std::vector<uint32_t> visibleChunks; //sorted by level so each level binds once
+
+	float cellSize(uint32_t level) const { return baseCellSize * static_cast<float>(1u << level); }
+	float chunkSize(uint32_t level) const { return chunkCells * cellSize(level); }
+};
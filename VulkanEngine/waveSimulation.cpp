@@ -0,0 +1,251 @@
+#include "waveSimulation.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "spdlog/spdlog.h"
+
+#include "descriptorManager.h"
+
+static constexpr VkFormat waveFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+static constexpr uint32_t workgroupSize = 8;
+
+WaveSimulation::WaveSimulation(Device& device, uint32_t resolution, float tileSize) : device{ device }, resolution{ resolution }, tileSize{ tileSize } {
+	createImage(displacementImage);
+	createImage(normalImage);
+	createSampler();
+
+	uniformBuffer = std::make_unique<Buffer>(
+		device,
+		sizeof(Constants::WaveUBO),
+		Swapchain::MAX_FRAMES_IN_FLIGHT,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		device.properties.limits.minUniformBufferOffsetAlignment);
+	uniformBuffer->map();
+
+	createDescriptorSets();
+	createPipeline();
+
+	//the set water.vert used to hardcode
+	setWaves({
+		{ { -0.3f, -0.6f }, 0.2f, 10.f },
+		{ { -0.9f, -0.3f }, 0.3f, 10.f },
+		{ { -0.6f, -0.4f }, 0.3f, 20.f },
+		{ { -0.5f, -0.5f }, 0.1f, 5.f },
+	});
+}
+
+WaveSimulation::~WaveSimulation() {
+	pipeline.reset();
+	vkDestroyPipelineLayout(device.device(), pipelineLayout, nullptr);
+	vkDestroyDescriptorPool(device.device(), descriptorPool, nullptr);
+	vkDestroySampler(device.device(), sampler, nullptr);
+	for (StorageImage* storageImage : { &displacementImage, &normalImage }) {
+		vkDestroyImageView(device.device(), storageImage->view, nullptr);
+		device.destroyImage(storageImage->image, storageImage->allocation);
+	}
+}
+
+void WaveSimulation::setWaves(const std::vector<Wave>& waves) {
+	if (waves.size() > Constants::maxWaves) {
+		spdlog::critical("At most {} waves are supported, got {}", Constants::maxWaves, waves.size());
+		throw std::runtime_error("setWaves");
+	}
+	this->waves = waves;
+
+	const float gravity = 9.8f;
+	const float period = 2.f * glm::pi<float>() / tileSize;
+	maxDisplacement = 0.f;
+	for (size_t i = 0; i < waves.size(); i++) {
+		const Wave& wave = waves[i];
+		glm::vec2 k = glm::normalize(wave.direction) * (2.f * glm::pi<float>() / wave.wavelength);
+		//whole periods over the tile, at least one so the wave can't vanish
+		k = glm::round(k / period) * period;
+		if (k == glm::vec2(0.f)) {
+			k.x = period;
+		}
+		float frequency = std::sqrt(gravity * glm::length(k));
+		waveData.waves[i] = glm::vec4(k, wave.steepness, frequency);
+		maxDisplacement += wave.steepness / glm::length(k);
+	}
+	waveData.params = glm::vec4(0.f, tileSize, static_cast<float>(waves.size()), 0.f);
+}
+
+void WaveSimulation::update(VkCommandBuffer commandBuffer, int frameIndex, float time) {
+	Constants::WaveUBO ubo = waveData;
+	ubo.params.x = time;
+	uniformBuffer->writeToIndex(&ubo, frameIndex, sizeof(ubo));
+
+	std::array<VkImageMemoryBarrier, 2> barriers{};
+	for (size_t i = 0; i < barriers.size(); i++) {
+		barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[i].image = i == 0 ? displacementImage.image : normalImage.image;
+		barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barriers[i].subresourceRange.levelCount = 1;
+		barriers[i].subresourceRange.layerCount = 1;
+		//the images stay in general layout, storage writes and sampled reads are both allowed there
+		barriers[i].oldLayout = imagesInitialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barriers[i].srcAccessMask = 0;
+		barriers[i].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	}
+
+	//the previous frame's water may still be sampling, one texture set is shared by all frames in flight
+	vkCmdPipelineBarrier(commandBuffer,
+		imagesInitialized ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data());
+	imagesInitialized = true;
+
+	pipeline->bind(commandBuffer);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frameIndex], 0, nullptr);
+	uint32_t groups = (resolution + workgroupSize - 1) / workgroupSize;
+	vkCmdDispatch(commandBuffer, groups, groups, 1);
+
+	for (auto& barrier : barriers) {
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
+void WaveSimulation::createImage(StorageImage& storageImage) {
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = resolution;
+	imageInfo.extent.height = resolution;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = waveFormat;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, storageImage.image, storageImage.allocation);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = storageImage.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = waveFormat;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(device.device(), &viewInfo, nullptr, &storageImage.view) != VK_SUCCESS) {
+		spdlog::critical("Failed to create wave image view");
+		throw std::runtime_error("createImage");
+	}
+}
+
+void WaveSimulation::createSampler() {
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1.f;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+
+	if (vkCreateSampler(device.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+		spdlog::critical("Failed to create wave sampler");
+		throw std::runtime_error("createSampler");
+	}
+}
+
+void WaveSimulation::createDescriptorSets() {
+	const uint32_t setCount = Swapchain::MAX_FRAMES_IN_FLIGHT;
+	std::array<VkDescriptorPoolSize, 3> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[0].descriptorCount = setCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = setCount * 2;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[2].descriptorCount = setCount * 2;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = setCount;
+
+	if (vkCreateDescriptorPool(device.device(), &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+		spdlog::critical("Failed to create wave descriptor pool");
+		throw std::runtime_error("createDescriptorSets");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(setCount, DescriptorManager::descriptorSetLayouts.waves);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = setCount;
+	allocInfo.pSetLayouts = layouts.data();
+
+	if (vkAllocateDescriptorSets(device.device(), &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+		spdlog::critical("Failed to allocate wave descriptor sets");
+		throw std::runtime_error("createDescriptorSets");
+	}
+
+	for (uint32_t i = 0; i < setCount; i++) {
+		VkDescriptorBufferInfo bufferInfo = uniformBuffer->descriptorInfoForIndex(i);
+
+		std::array<VkDescriptorImageInfo, 4> imageInfos{};
+		imageInfos[0] = { VK_NULL_HANDLE, displacementImage.view, VK_IMAGE_LAYOUT_GENERAL };
+		imageInfos[1] = { VK_NULL_HANDLE, normalImage.view, VK_IMAGE_LAYOUT_GENERAL };
+		imageInfos[2] = { sampler, displacementImage.view, VK_IMAGE_LAYOUT_GENERAL };
+		imageInfos[3] = { sampler, normalImage.view, VK_IMAGE_LAYOUT_GENERAL };
+
+		std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
+		for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+			descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[binding].dstSet = descriptorSets[i];
+			descriptorWrites[binding].dstBinding = binding;
+			descriptorWrites[binding].dstArrayElement = 0;
+			descriptorWrites[binding].descriptorCount = 1;
+		}
+		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrites[0].pBufferInfo = &bufferInfo;
+		for (uint32_t binding = 1; binding < descriptorWrites.size(); binding++) {
+			descriptorWrites[binding].descriptorType = binding < 3 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptorWrites[binding].pImageInfo = &imageInfos[binding - 1];
+		}
+
+		vkUpdateDescriptorSets(device.device(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	}
+}
+
+void WaveSimulation::createPipeline() {
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &DescriptorManager::descriptorSetLayouts.waves;
+	pipelineLayoutInfo.pushConstantRangeCount = 0;
+
+	if (vkCreatePipelineLayout(device.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+		spdlog::critical("Failed to create pipeline layout");
+		throw std::runtime_error("createPipeline");
+	}
+
+	pipeline = std::make_unique<ComputePipeline>(device, "shaders/waves.spv", pipelineLayout);
+}
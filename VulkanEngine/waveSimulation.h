@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "glm/glm.hpp"
+
+#include "device.h"
+#include "buffer.h"
+#include "computePipeline.h"
+#include "constants.h"
+#include "swapchain.h"
+
+//evaluates the gerstner wave set once per frame into a tiling displacement and normal texture
+//the water vertex shader samples those instead of summing the waves per vertex
+class WaveSimulation {
+public:
+	struct Wave {
+		glm::vec2 direction;
+		float steepness;
+		float wavelength;
+	};
+
+	//resolution is the texel count per side of one tile, tileSize its extent in world units
+	WaveSimulation(Device& device, uint32_t resolution = 256, float tileSize = 80.f);
+	~WaveSimulation();
+
+	//delete copy constructors
+	WaveSimulation(const WaveSimulation&) = delete;
+	WaveSimulation& operator=(const WaveSimulation&) = delete;
+
+	//wave vectors are snapped to whole periods over the tile so the textures repeat seamlessly
+	void setWaves(const std::vector<Wave>& waves);
+	const std::vector<Wave>& getWaves() const { return waves; }
+
+	//has to be recorded outside of the render pass, before anything samples the textures this frame
+	void update(VkCommandBuffer commandBuffer, int frameIndex, float time);
+
+	VkDescriptorSet getDescriptorSet(int frameIndex) const { return descriptorSets[frameIndex]; }
+	float getTileSize() const { return tileSize; }
+	//upper bound of the displacement, used to pad bounds for culling
+	float getMaxDisplacement() const { return maxDisplacement; }
+
+private:
+	Device& device;
+	uint32_t resolution;
+	float tileSize;
+
+	std::vector<Wave> waves;
+	Constants::WaveUBO waveData{};
+	float maxDisplacement = 0.f;
+
+	struct StorageImage {
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		Allocation allocation{};
+	};
+	StorageImage displacementImage;
+	StorageImage normalImage;
+	bool imagesInitialized = false;
+
+	VkSampler sampler;
+	VkDescriptorPool descriptorPool;
+	std::array<VkDescriptorSet, Swapchain::MAX_FRAMES_IN_FLIGHT> descriptorSets;
+	std::unique_ptr<Buffer> uniformBuffer;
+
+	VkPipelineLayout pipelineLayout;
+	std::unique_ptr<ComputePipeline> pipeline;
+
+	void createImage(StorageImage& storageImage);
+	void createSampler();
+	void createDescriptorSets();
+	void createPipeline();
+};
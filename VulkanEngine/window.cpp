@@ -1,10 +1,12 @@
 #include "window.h"
 
 #include <stdexcept>
+#include <chrono>
 
 #include "spdlog/spdlog.h"
 
 #include "inputManager.h"
+#include "settings.h"
 
 Window::Window(int width, int height, std::string name) :
 	width{ width }, height{ height }, name{ name } {
@@ -12,11 +14,20 @@ Window::Window(int width, int height, std::string name) :
 }
 
 Window::~Window() {
+	if (Settings::headless) {
+		return;
+	}
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
 
 void Window::initWindow() {
+	//no display on headless nodes, nothing from glfw is needed
+	if (Settings::headless) {
+		spdlog::info("Running headless {}x{}", width, height);
+		return;
+	}
+
 	glfwInit();
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
@@ -33,14 +44,39 @@ void Window::initWindow() {
 }
 
 bool Window::shouldClose() {
+	if (Settings::headless) {
+		return closeRequested;
+	}
 	return glfwWindowShouldClose(window);
 }
 
+void Window::pollEvents() {
+	if (!Settings::headless) {
+		glfwPollEvents();
+	}
+}
+
 void Window::setWindowShouldClose() {
+	if (Settings::headless) {
+		closeRequested = true;
+		return;
+	}
 	glfwSetWindowShouldClose(window, GLFW_TRUE);
 }
 
+double Window::getTime() {
+	if (Settings::headless) {
+		static const auto start = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return glfwGetTime();
+}
+
 void Window::createWindowSurface(VkInstance instance, VkSurfaceKHR* surface) {
+	if (Settings::headless) {
+		spdlog::critical("Cannot create a window surface in headless mode");
+		throw std::runtime_error("createWindowSurface");
+	}
 	if (glfwCreateWindowSurface(instance, window, nullptr, surface)) {
 		spdlog::critical("Failed to create window surface");
 		throw std::runtime_error("createWindowSurface");
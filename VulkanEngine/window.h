@@ -15,20 +15,25 @@ public:
 	Window& operator=(const Window&) = delete;
 
 	bool shouldClose();
+	void pollEvents();
 	VkExtent2D getExtent() { return {static_cast<uint32_t>(width), static_cast<uint32_t>(height)}; }
 	void createWindowSurface(VkInstance instance, VkSurfaceKHR* surface);
 
 	bool windowResized() { return framebufferResized; }
 	void resetWindowResizedFlag() { framebufferResized = false; }
 	void setWindowShouldClose();
+
+	//seconds since start, valid with or without a glfw window
+	static double getTime();
 private:
-	GLFWwindow* window;
+	GLFWwindow* window = nullptr;
 
 	//window information
 	int width;
 	int height;
 	std::string name;
-	bool framebufferResized;
+	bool framebufferResized = false;
+	bool closeRequested = false;
 
 	void initWindow();
 	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);